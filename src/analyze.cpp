@@ -0,0 +1,163 @@
+#include "chess.hpp"
+#include "search.hpp"
+#include "log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Headless search of a single position, prints every finished iteration and the move it picked.
+//
+// usage: analyze [options] [fen]   the start position by default
+//
+// options: --depth N  iterations to run, all the way to the ply limit by default
+//          --nodes N  stop after this many nodes
+//          --time MS  stop after this many milliseconds, through the same flag a gui would set
+//          --hash MB  transposition table size, 16 MB by default, 0 to search without one
+//          --threads N  lazy smp over N threads sharing the table, 1 by default
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+static bool parse_number(const char* arg, int min, int max, int* value)
+{
+    bool success = false;
+    *value = string_to_integer(String(arg), &success);
+    if (!success || *value < min || *value > max)
+    {
+        log_error("Invalid number %s, expected %d to %d", arg, min, max);
+        return false;
+    }
+
+    return true;
+}
+
+static void report_iteration(const SearchReport& report, void*)
+{
+    print_search_report(report);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    int depth = MAX_SEARCH_PLY - 1;
+    int nodes = 0;
+    int milliseconds = 0;
+    int hash_megabytes = 16;
+    int threads = 1;
+    const char* fen = START_FEN;
+
+    for (int i = 1; i < argc; i++)
+    {
+        String arg = String(argv[i]);
+        if (string_compare(arg, make_string("--depth")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, MAX_SEARCH_PLY - 1, &depth))
+                return 1;
+        }
+        else if (string_compare(arg, make_string("--nodes")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, 2000000000, &nodes))
+                return 1;
+        }
+        else if (string_compare(arg, make_string("--time")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, 1000000000, &milliseconds))
+                return 1;
+        }
+        else if (string_compare(arg, make_string("--hash")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 0, 1 << 20, &hash_megabytes))
+                return 1;
+        }
+        else if (string_compare(arg, make_string("--threads")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, 1024, &threads))
+                return 1;
+        }
+        else if (arg.size && arg[0] != '-')
+        {
+            fen = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--depth N] [--nodes N] [--time MS] [--hash MB] [--threads N] [fen]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // without any limit the search would run to the ply limit, which never finishes
+    if (depth == MAX_SEARCH_PLY - 1 && !nodes && !milliseconds)
+    {
+        depth = 8;
+    }
+
+    initialize_attack_tables();
+
+    ChessState state;
+    if (!parse_fen_string(&state, String(fen)))
+    {
+        log_error("Could not parse fen %s", fen);
+        return 1;
+    }
+
+    std::atomic<bool> stop = false;
+
+    TranspositionTable table;
+    if (hash_megabytes)
+    {
+        if (!table.resize(hash_megabytes))
+        {
+            log_error("Could not allocate a %d MB transposition table", hash_megabytes);
+            return 1;
+        }
+        table.new_search();
+    }
+
+    ParallelSearch search;
+    search.thread_count = threads;
+    search.limits.depth = depth;
+    search.limits.nodes = u64(nodes);
+    search.stop = &stop;
+    search.table = hash_megabytes ? &table : nullptr;
+    search.on_iteration = report_iteration;
+
+    std::atomic<bool> finished = false;
+    std::thread timer;
+    if (milliseconds)
+    {
+        timer = std::thread([&] {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+            while (!finished && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            stop = true;
+        });
+    }
+
+    SearchReport report = search.run(state, KeyHistory());
+    finished = true;
+    if (timer.joinable())
+        timer.join();
+
+    char name[6] = "none";
+    if (!report.best_move().is_null())
+        move_to_string(report.best_move(), name);
+
+    printf("\nbest move %s  depth %d  threads %d  nodes %llu  time %.3f s  %.2f Mnps\n", name, report.depth, threads,
+           (unsigned long long)report.nodes, report.seconds, report.seconds > 0 ? report.nodes / report.seconds / 1e6 : 0.0);
+
+    printf("\nmove picker stages reached\n");
+    search.picker_stats.print();
+
+    printf("\nmove ordering\n");
+    search.ordering_stats.print();
+
+    if (hash_megabytes)
+    {
+        printf("\ntransposition table %llu MB, hashfull %d\n", (unsigned long long)(table.size_in_bytes() >> 20), table.hashfull());
+        search.table_stats.print();
+    }
+
+    return 0;
+}
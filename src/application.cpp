@@ -64,6 +64,8 @@ bool Application::initialize()
         }
     }
 
+    initialize_attack_tables();
+
     ChessState state;
     String start = String("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
     String random = String("RRRRRRRR/PPPPPPPP/8/8/8/8/PPPPPPPP/BBBBBBBB w KQkq - 0 1");
@@ -185,6 +187,16 @@ bool Application::keyboard_input(SDL_KeyboardEvent keyboard)
             SDL_SetWindowFullscreen(m_window.window, !is_fullscreen());
             return true;
         }
+        case SDL_SCANCODE_LEFT:
+        {
+            m_selected_square = NullSquareIndex;
+            return game.undo_move();
+        }
+        case SDL_SCANCODE_RIGHT:
+        {
+            m_selected_square = NullSquareIndex;
+            return game.redo_move();
+        }
     }
 
     return false;
@@ -205,15 +217,23 @@ bool Application::mouse_input()
         int column = int(floorf((mouse_pos.x - margin.x) / square_size));
 
         SquareIndex square = row * 8 + column;
-        if (m_selected_square != NullSquareIndex)
+        if (m_selected_square != NullSquareIndex && (game.maps.moves[m_selected_square] & BIT(square)))
         {
-            game.make_move(m_selected_square, square);
+            if (game.make_move(m_selected_square, square) && game.is_draw())
+            {
+                log_info("The game is drawn");
+            }
             m_selected_square = NullSquareIndex;
         }
-        else
+        else if (game.maps.moves[square])
         {
+            // clicking another piece that can move selects it instead
             m_selected_square = square;
         }
+        else
+        {
+            m_selected_square = NullSquareIndex;
+        }
         return true;
     }
     else
@@ -313,42 +333,37 @@ void Application::draw_board()
             {
                 color = is_white ? ColorF(0.8, 0.5, 0.5) : ColorF(0.6, 0.3, 0.3);
             }
+            else if (m_selected_square != NullSquareIndex && (game.maps.moves[m_selected_square] & BIT(index)))
+            {
+                color = is_white ? ColorF(0.6, 0.8, 0.5) : ColorF(0.4, 0.6, 0.3);
+            }
             render_rectangle(Rectangle(margin.x + i * square_size, margin.y + j * square_size, square_size, square_size), color, false);
         }
     }
 
-    ChessState state = game.position.board;
-    while (state.white)
+    const ChessState& state = game.position.board;
+    Bitboard white = state.white;
+    Bitboard black = state.black;
+    while (white)
     {
-        int index = pop_lsb(&state.white);
+        int index = pop_lsb(&white);
         draw_piece(state, index, true);
     }
-    while (state.black)
+    while (black)
     {
-        int index = pop_lsb(&state.black);
+        int index = pop_lsb(&black);
         draw_piece(state, index, false);
     }
 }
 
-void Application::draw_piece(ChessState& state, SquareIndex index, bool is_white)
+void Application::draw_piece(const ChessState& state, SquareIndex index, bool is_white)
 {
     BoardPosition position = index_to_board_position(index);
-    Bitboard square = BIT(index);
-    PieceType piece_type = PieceType::King;
+    PieceType piece_type = state.piece_on(index);
 
-    bool found = false;
-    for (int i = 0; i < PieceType::Count; i++)
-    {
-        if (state.pieces[i] & square)
-        {
-            piece_type = PieceType(i);
-            found = true;
-            break;
-        }
-    }
-
-    if (!found) {
+    if (piece_type == PieceType::Sentinel) {
         log_error("Invalid call to draw_piece");
+        return;
     }
 
     Rectangle area = calculate_square_area(position.row, position.column);
@@ -102,7 +102,7 @@ private:
 
     bool is_fullscreen() const;
 
-    void draw_piece(ChessState& state, SquareIndex index, bool is_white);
+    void draw_piece(const ChessState& state, SquareIndex index, bool is_white);
 
     static vec2 calculate_board_margin(vec2 render_size, float board_size);
 };
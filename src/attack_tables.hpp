@@ -0,0 +1,100 @@
+#ifndef _ATTACK_TABLES_H
+#define _ATTACK_TABLES_H
+
+#include "chess.hpp"
+
+// Attack sets of the pieces that do not slide, generated at compile time so a lookup is a
+// single load. Squares are indexed row * 8 + column, a1 = 0, h8 = 63.
+
+// Everything but the named files. A whole bitboard shifted sideways pushes squares over the
+// edge onto the far file, the set-wise fills mask them off with these.
+#define NOT_FILE_A  0xfefefefefefefefeull
+#define NOT_FILE_H  0x7f7f7f7f7f7f7f7full
+#define NOT_FILE_AB 0xfcfcfcfcfcfcfcfcull
+#define NOT_FILE_GH 0x3f3f3f3f3f3f3f3full
+
+struct AttackTable {
+    Bitboard squares[64] = {};
+
+    constexpr Bitboard operator[](int index) const { return squares[index]; }
+};
+
+struct LeaperStep {
+    int row;
+    int column;
+};
+
+template <int N>
+constexpr AttackTable make_leaper_table(const LeaperStep (&steps)[N])
+{
+    AttackTable table;
+
+    for (int square = 0; square < 64; square++)
+    {
+        for (int i = 0; i < N; i++)
+        {
+            // stepping by rows and columns instead of index offsets, so nothing wraps around the board edge
+            int row = square / 8 + steps[i].row;
+            int column = square % 8 + steps[i].column;
+
+            if (row >= 0 && row < 8 && column >= 0 && column < 8)
+            {
+                table.squares[square] |= BIT(row * 8 + column);
+            }
+        }
+    }
+
+    return table;
+}
+
+inline constexpr LeaperStep KnightSteps[8] = {
+    { 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 },
+    { 1, 2 }, { 1, -2 }, { -1, 2 }, { -1, -2 },
+};
+
+inline constexpr LeaperStep KingSteps[8] = {
+    { 1, -1 }, { 1, 0 }, { 1, 1 },
+    { 0, -1 },           { 0, 1 },
+    { -1, -1 }, { -1, 0 }, { -1, 1 },
+};
+
+inline constexpr LeaperStep WhitePawnSteps[2] = { { 1, -1 }, { 1, 1 } };
+inline constexpr LeaperStep BlackPawnSteps[2] = { { -1, -1 }, { -1, 1 } };
+
+inline constexpr AttackTable KnightAttackTable = make_leaper_table(KnightSteps);
+inline constexpr AttackTable KingAttackTable = make_leaper_table(KingSteps);
+// indexed by ChessColor
+inline constexpr AttackTable PawnAttackTable[2] = {
+    make_leaper_table(WhitePawnSteps),
+    make_leaper_table(BlackPawnSteps),
+};
+
+static inline Bitboard knight_attacks(SquareIndex square)
+{
+    return KnightAttackTable[square];
+}
+
+static inline Bitboard king_attacks(SquareIndex square)
+{
+    return KingAttackTable[square];
+}
+
+// squares a pawn of the given color standing on the square attacks
+static inline Bitboard pawn_attacks(ChessColor color, SquareIndex square)
+{
+    return PawnAttackTable[int(color)][square];
+}
+
+// self checks, square indices: a1 = 0, h1 = 7, d4 = 27, e4 = 28, a8 = 56, h8 = 63
+static_assert(KnightAttackTable[0] == (BIT(10) | BIT(17)), "knight a1 attacks c2 b3");
+static_assert(KnightAttackTable[7] == (BIT(13) | BIT(22)), "knight h1 attacks f2 g3 and does not wrap to the a file");
+static_assert(KnightAttackTable[27] == (BIT(10) | BIT(12) | BIT(17) | BIT(21) | BIT(33) | BIT(37) | BIT(42) | BIT(44)),
+              "knight d4 attacks all eight squares");
+static_assert(KingAttackTable[0] == (BIT(1) | BIT(8) | BIT(9)), "king a1 attacks b1 a2 b2");
+static_assert(KingAttackTable[63] == (BIT(54) | BIT(55) | BIT(62)), "king h8 attacks g7 h7 g8");
+static_assert(PawnAttackTable[0][28] == (BIT(35) | BIT(37)), "white pawn e4 attacks d5 f5");
+static_assert(PawnAttackTable[1][28] == (BIT(19) | BIT(21)), "black pawn e4 attacks d3 f3");
+static_assert(PawnAttackTable[0][15] == BIT(22), "white pawn h2 attacks g3 only");
+static_assert(PawnAttackTable[0][56] == 0, "white pawn on the last row attacks nothing");
+
+#endif // _ATTACK_TABLES_H
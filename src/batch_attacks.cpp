@@ -0,0 +1,231 @@
+#include "batch_attacks.hpp"
+#include "attack_tables.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define HAS_AVX2 0
+#endif
+
+// the kernel is compiled for avx2 on its own, so the rest of the library still runs anywhere
+#if HAS_AVX2 && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+static BatchBackend default_batch_backend()
+{
+    return cpu_features().avx2 ? BatchBackend::Avx2 : BatchBackend::Scalar;
+}
+
+BatchBackend active_batch_backend = default_batch_backend();
+
+const char* batch_backend_name(BatchBackend backend)
+{
+    switch (backend)
+    {
+        case BatchBackend::Scalar: return "scalar";
+        case BatchBackend::Avx2:   return "avx2";
+    }
+    return "unknown";
+}
+
+bool set_batch_backend(BatchBackend backend)
+{
+    if (backend == BatchBackend::Avx2 && !(HAS_AVX2 && cpu_features().avx2))
+    {
+        return false;
+    }
+
+    active_batch_backend = backend;
+    return true;
+}
+
+static Bitboard side_attacks(const ChessState& state, Bitboard side, ChessColor color, Bitboard occupied)
+{
+    Bitboard attacks = 0;
+
+    Bitboard pawns = state.pieces[PieceType::Pawn] & side;
+    while (pawns)
+        attacks |= pawn_attacks(color, pop_lsb(&pawns));
+
+    Bitboard knights = state.pieces[PieceType::Knight] & side;
+    while (knights)
+        attacks |= knight_attacks(pop_lsb(&knights));
+
+    Bitboard diagonal = (state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen]) & side;
+    while (diagonal)
+        attacks |= bishop_attacks(pop_lsb(&diagonal), occupied);
+
+    Bitboard orthogonal = (state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen]) & side;
+    while (orthogonal)
+        attacks |= rook_attacks(pop_lsb(&orthogonal), occupied);
+
+    Bitboard king = state.pieces[PieceType::King] & side;
+    if (king)
+        attacks |= king_attacks(TRAILING_ZEROS(king));
+
+    return attacks;
+}
+
+static void compute_scalar(const ChessState* states, int count, BatchAttacks* attacks)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const ChessState& state = states[i];
+        Bitboard occupied = state.white | state.black;
+        attacks[i].white = side_attacks(state, state.white, ChessColor::White, occupied);
+        attacks[i].black = side_attacks(state, state.black, ChessColor::Black, occupied);
+    }
+}
+
+#if HAS_AVX2
+
+// Shifts by a whole direction, positive towards h8. Whatever crosses the side of the board
+// lands on the far file, the mask given with the direction removes it.
+TARGET_AVX2 static inline __m256i shift(__m256i b, int amount)
+{
+    return amount > 0 ? _mm256_slli_epi64(b, amount) : _mm256_srli_epi64(b, -amount);
+}
+
+// Occluded fill in one direction: three doubling steps cover the seven squares of a ray. The
+// propagator is the empty squares, minus the file a step would wrap from.
+TARGET_AVX2 static inline __m256i ray_attacks(__m256i sliders, __m256i empty, int amount, __m256i file_mask)
+{
+    __m256i generate = sliders;
+    __m256i propagate = _mm256_and_si256(empty, file_mask);
+
+    generate = _mm256_or_si256(generate, _mm256_and_si256(propagate, shift(generate, amount)));
+    propagate = _mm256_and_si256(propagate, shift(propagate, amount));
+    generate = _mm256_or_si256(generate, _mm256_and_si256(propagate, shift(generate, 2 * amount)));
+    propagate = _mm256_and_si256(propagate, shift(propagate, 2 * amount));
+    generate = _mm256_or_si256(generate, _mm256_and_si256(propagate, shift(generate, 4 * amount)));
+
+    // one more step takes the ray onto the first blocker
+    return _mm256_and_si256(shift(generate, amount), file_mask);
+}
+
+TARGET_AVX2 static inline __m256i step_attacks(__m256i pieces, int amount, __m256i file_mask)
+{
+    return _mm256_and_si256(shift(pieces, amount), file_mask);
+}
+
+TARGET_AVX2 static __m256i side_attacks_x4(const __m256i pieces[PieceType::Count], __m256i side, __m256i empty, bool white)
+{
+    const __m256i all = _mm256_set1_epi64x(-1);
+    const __m256i not_a = _mm256_set1_epi64x(NOT_FILE_A);
+    const __m256i not_h = _mm256_set1_epi64x(NOT_FILE_H);
+    const __m256i not_ab = _mm256_set1_epi64x(NOT_FILE_AB);
+    const __m256i not_gh = _mm256_set1_epi64x(NOT_FILE_GH);
+
+    __m256i queens = pieces[PieceType::Queen];
+    __m256i orthogonal = _mm256_and_si256(_mm256_or_si256(pieces[PieceType::Rook], queens), side);
+    __m256i diagonal = _mm256_and_si256(_mm256_or_si256(pieces[PieceType::Bishop], queens), side);
+    __m256i knights = _mm256_and_si256(pieces[PieceType::Knight], side);
+    __m256i king = _mm256_and_si256(pieces[PieceType::King], side);
+    __m256i pawns = _mm256_and_si256(pieces[PieceType::Pawn], side);
+
+    __m256i attacks = _mm256_or_si256(ray_attacks(orthogonal, empty, 8, all), ray_attacks(orthogonal, empty, -8, all));
+    attacks = _mm256_or_si256(attacks, ray_attacks(orthogonal, empty, 1, not_a));
+    attacks = _mm256_or_si256(attacks, ray_attacks(orthogonal, empty, -1, not_h));
+    attacks = _mm256_or_si256(attacks, ray_attacks(diagonal, empty, 9, not_a));
+    attacks = _mm256_or_si256(attacks, ray_attacks(diagonal, empty, 7, not_h));
+    attacks = _mm256_or_si256(attacks, ray_attacks(diagonal, empty, -7, not_a));
+    attacks = _mm256_or_si256(attacks, ray_attacks(diagonal, empty, -9, not_h));
+
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, 17, not_a));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, 15, not_h));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, 10, not_ab));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, 6, not_gh));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, -6, not_ab));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, -10, not_gh));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, -15, not_a));
+    attacks = _mm256_or_si256(attacks, step_attacks(knights, -17, not_h));
+
+    // the king ring is a fill of one step in every direction
+    __m256i row = _mm256_or_si256(king, _mm256_or_si256(step_attacks(king, 1, not_a), step_attacks(king, -1, not_h)));
+    __m256i ring = _mm256_or_si256(row, _mm256_or_si256(shift(row, 8), shift(row, -8)));
+    attacks = _mm256_or_si256(attacks, _mm256_andnot_si256(king, ring));
+
+    if (white)
+    {
+        attacks = _mm256_or_si256(attacks, step_attacks(pawns, 9, not_a));
+        attacks = _mm256_or_si256(attacks, step_attacks(pawns, 7, not_h));
+    }
+    else
+    {
+        attacks = _mm256_or_si256(attacks, step_attacks(pawns, -7, not_a));
+        attacks = _mm256_or_si256(attacks, step_attacks(pawns, -9, not_h));
+    }
+
+    return attacks;
+}
+
+// The kernel's fills one position at a time, the set-wise functions of chess.hpp are the
+// scalar form of the same thing
+static Bitboard side_fill_attacks(const ChessState& state, Bitboard side, ChessColor color, Bitboard empty)
+{
+    Bitboard queens = state.pieces[PieceType::Queen];
+    return orthogonal_fill((state.pieces[PieceType::Rook] | queens) & side, empty)
+         | diagonal_fill((state.pieces[PieceType::Bishop] | queens) & side, empty)
+         | knight_fill(state.pieces[PieceType::Knight] & side)
+         | king_fill(state.pieces[PieceType::King] & side)
+         | pawn_fill(state.pieces[PieceType::Pawn] & side, color);
+}
+
+TARGET_AVX2 static void compute_avx2(const ChessState* states, int count, BatchAttacks* attacks)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const ChessState* s = states + i;
+
+        // one position per lane, lane 0 holds the first
+        __m256i white = _mm256_set_epi64x(s[3].white, s[2].white, s[1].white, s[0].white);
+        __m256i black = _mm256_set_epi64x(s[3].black, s[2].black, s[1].black, s[0].black);
+
+        __m256i pieces[PieceType::Count];
+        for (int type = 0; type < PieceType::Count; type++)
+        {
+            pieces[type] = _mm256_set_epi64x(s[3].pieces[type], s[2].pieces[type], s[1].pieces[type], s[0].pieces[type]);
+        }
+
+        __m256i empty = _mm256_xor_si256(_mm256_or_si256(white, black), _mm256_set1_epi64x(-1));
+
+        alignas(32) u64 white_attacks[4];
+        alignas(32) u64 black_attacks[4];
+        _mm256_store_si256((__m256i*)white_attacks, side_attacks_x4(pieces, white, empty, true));
+        _mm256_store_si256((__m256i*)black_attacks, side_attacks_x4(pieces, black, empty, false));
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            attacks[i + lane].white = white_attacks[lane];
+            attacks[i + lane].black = black_attacks[lane];
+        }
+    }
+
+    // the last one to three positions do not fill a vector
+    for (; i < count; i++)
+    {
+        Bitboard empty = ~(states[i].white | states[i].black);
+        attacks[i].white = side_fill_attacks(states[i], states[i].white, ChessColor::White, empty);
+        attacks[i].black = side_fill_attacks(states[i], states[i].black, ChessColor::Black, empty);
+    }
+}
+
+#endif
+
+void compute_batch_attacks(const ChessState* states, int count, BatchAttacks* attacks)
+{
+#if HAS_AVX2
+    if (active_batch_backend == BatchBackend::Avx2)
+    {
+        compute_avx2(states, count, attacks);
+        return;
+    }
+#endif
+
+    compute_scalar(states, count, attacks);
+}
@@ -0,0 +1,29 @@
+#ifndef _BATCH_ATTACKS_H
+#define _BATCH_ATTACKS_H
+
+#include "chess.hpp"
+
+// Attack sets for many positions at once, for bulk work over datasets where only the squares
+// each side attacks are wanted and not the moves.
+
+struct BatchAttacks {
+    Bitboard white = 0;  // every square a white piece attacks
+    Bitboard black = 0;
+};
+
+// Scalar goes piece by piece through the attack tables. Avx2 runs kogge-stone fills over whole
+// piece sets with one position per 64 bit lane, four positions per instruction.
+enum class BatchBackend {
+    Scalar,
+    Avx2,
+};
+
+extern BatchBackend active_batch_backend;
+const char* batch_backend_name(BatchBackend backend);
+// false when the cpu can not run the backend, the active one stays as it was
+bool set_batch_backend(BatchBackend backend);
+
+// attacks[i] is filled for states[i], the slider tables have to be initialized for the scalar backend
+void compute_batch_attacks(const ChessState* states, int count, BatchAttacks* attacks);
+
+#endif // _BATCH_ATTACKS_H
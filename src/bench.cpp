@@ -0,0 +1,958 @@
+#include "chess.hpp"
+#include "attack_tables.hpp"
+#include "batch_attacks.hpp"
+#include "epd.hpp"
+#include "search.hpp"
+#include "see.hpp"
+#include "log.hpp"
+
+#include <chrono>
+#include <thread>
+
+// Headless microbenchmarks for the chess library.
+// usage: bench <name> [iterations]
+
+static const char* BenchPositions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 0 8",
+    "2r2rk1/1b2qppp/p3pn2/1p6/3N4/P1N1P3/1P2QPPP/2RR2K1 b - - 0 19",
+};
+
+static double elapsed_seconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static bool load_bench_positions(ChessState* states, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (!parse_fen_string(&states[i], String(BenchPositions[i])))
+        {
+            log_error("Could not parse bench position %s", BenchPositions[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// the square by square walker the slider functions used before the magic tables,
+// kept here so both can be timed against each other
+static Bitboard ray_walk_moves(Bitboard pieces, Bitboard blockers, Bitboard captures, Array<int> offsets, int depth)
+{
+    Bitboard moves = 0;
+
+    while (pieces)
+    {
+        SquareIndex index = pop_lsb(&pieces);
+
+        for (int i = 0; i < offsets.size; i++)
+        {
+            int step = offsets[i];
+            int square_index = index + step;
+            int row    = square_index / 8;
+            int column = square_index % 8;
+
+            int iter = 0;
+
+            while ((row < 8 && row >= 0 && column < 8 && column >= 0) && iter < depth)
+            {
+                Bitboard m = BIT(square_index);
+                if (m & blockers)
+                {
+                    break;
+                }
+                if (m & captures)
+                {
+                    moves |= m;
+                    break;
+                }
+
+                moves |= m;
+
+                square_index += step;
+                row = square_index / 8;
+                column = square_index % 8;
+
+                iter += 1;
+            }
+        }
+    }
+
+    return moves;
+}
+
+struct SliderSample {
+    Bitboard piece;
+    Bitboard blockers;
+    Bitboard captures;
+    bool orthogonal;
+};
+
+static void bench_sliders(int iterations)
+{
+    ChessState states[ARRAY_SIZE(BenchPositions)];
+    if (!load_bench_positions(states, ARRAY_SIZE(BenchPositions)))
+        return;
+
+    SliderSample samples[ARRAY_SIZE(BenchPositions) * 32];
+    int sample_count = 0;
+
+    for (const ChessState& state : states)
+    {
+        Bitboard friendly = state.side_to_move == ChessColor::White ? state.white : state.black;
+        Bitboard opponent = state.side_to_move == ChessColor::White ? state.black : state.white;
+
+        Bitboard orthogonal = (state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen]) & friendly;
+        Bitboard diagonal = (state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen]) & friendly;
+
+        while (orthogonal)
+            samples[sample_count++] = { BIT(pop_lsb(&orthogonal)), friendly, opponent, true };
+        while (diagonal)
+            samples[sample_count++] = { BIT(pop_lsb(&diagonal)), friendly, opponent, false };
+    }
+
+    int orthogonal_offsets[4] = { -8, -1, 1, 8 };
+    int diagonal_offsets[4] = { -9, -7, 7, 9 };
+
+    Bitboard checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int j = 0; j < sample_count; j++)
+        {
+            const SliderSample& s = samples[j];
+            checksum += s.orthogonal
+                ? ray_walk_moves(s.piece, s.blockers, s.captures, make_array(orthogonal_offsets), 8)
+                : ray_walk_moves(s.piece, s.blockers, s.captures, make_array(diagonal_offsets), 8);
+        }
+    }
+    double ray_walk_time = elapsed_seconds(start);
+
+    double attacks = double(iterations) * sample_count;
+    printf("sliders: %d pieces over %d positions, %d iterations\n",
+           sample_count, int(ARRAY_SIZE(BenchPositions)), iterations);
+    printf("  ray walk     %8.2f M attacks/s\n", attacks / ray_walk_time / 1e6);
+
+    SliderBackend selected = active_slider_backend;
+    SliderBackend backends[] = { SliderBackend::Magic, SliderBackend::Pext };
+
+    for (SliderBackend backend : backends)
+    {
+        if (!set_slider_backend(backend))
+        {
+            printf("  %-12s not supported by this cpu\n", slider_backend_name(backend));
+            continue;
+        }
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            for (int j = 0; j < sample_count; j++)
+            {
+                const SliderSample& s = samples[j];
+                checksum += s.orthogonal
+                    ? calculate_orthogonal_moves(s.piece, s.blockers, s.captures)
+                    : calculate_diagonal_moves(s.piece, s.blockers, s.captures);
+            }
+        }
+        double table_time = elapsed_seconds(start);
+
+        printf("  %-12s %8.2f M attacks/s  (%.1fx)\n", slider_backend_name(backend),
+               attacks / table_time / 1e6, ray_walk_time / table_time);
+    }
+
+    set_slider_backend(selected);
+    printf("  (checksum %016llx)\n", (unsigned long long)checksum);
+}
+
+// Games for the replay benchmarks, random playouts from the bench positions with a fixed seed so
+// every run replays the same moves. There is no game database in the tree, and what matters
+// here is that pieces move, capture and promote the way they do in real games.
+struct BenchGame {
+    ChessState start;
+    FixedArray<ChessMove, 256> moves;
+};
+
+static u64 bench_random(u64* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+static bool generate_bench_games(BenchGame* games, int count)
+{
+    ChessState states[ARRAY_SIZE(BenchPositions)];
+    if (!load_bench_positions(states, ARRAY_SIZE(BenchPositions)))
+        return false;
+
+    u64 seed = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < count; i++)
+    {
+        BenchGame& game = games[i];
+        game.start = states[i % ARRAY_SIZE(BenchPositions)];
+        game.moves.clear();
+
+        ChessState state = game.start;
+        while (!game.moves.is_full())
+        {
+            MoveList moves;
+            generate_legal_moves(state, &moves);
+            if (moves.is_empty())
+                break;
+
+            ChessMove move = moves[int(bench_random(&seed) % moves.size())];
+            ChessUndo undo;
+            make_move(&state, move, &undo);
+            game.moves.add(move);
+        }
+    }
+
+    return true;
+}
+
+static bool attack_maps_equal(const ChessPosition& a, const SquareMaps& a_maps, const ChessPosition& b, const SquareMaps& b_maps)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        if (a_maps.attacks[i] != b_maps.attacks[i])
+            return false;
+    }
+
+    return a.white_attacks == b.white_attacks && a.black_attacks == b.black_attacks;
+}
+
+static void bench_attack_maps(int game_count)
+{
+    BenchGame* games = new BenchGame[game_count];
+    if (!generate_bench_games(games, game_count))
+    {
+        delete[] games;
+        return;
+    }
+
+    // untimed pass first, the incremental maps have to match a full recompute after every move and take back
+    u64 plies = 0;
+    for (int i = 0; i < game_count; i++)
+    {
+        ChessPosition incremental, full;
+        SquareMaps incremental_maps, full_maps;
+        calculate_position(games[i].start, &incremental, &incremental_maps);
+        ChessUndo undos[256];
+
+        for (int j = 0; j < games[i].moves.size(); j++)
+        {
+            make_move(&incremental, &incremental_maps, games[i].moves[j], &undos[j]);
+            calculate_position(incremental.board, &full, &full_maps);
+            if (!attack_maps_equal(incremental, incremental_maps, full, full_maps))
+            {
+                log_error("Attack maps differ from a full recompute in game %d after ply %d", i, j + 1);
+                delete[] games;
+                return;
+            }
+        }
+
+        for (int j = games[i].moves.size() - 1; j >= 0; j--)
+        {
+            unmake_move(&incremental, &incremental_maps, games[i].moves[j], undos[j]);
+        }
+
+        calculate_position(games[i].start, &full, &full_maps);
+        if (!attack_maps_equal(incremental, incremental_maps, full, full_maps))
+        {
+            log_error("Attack maps differ from a full recompute after taking back game %d", i);
+            delete[] games;
+            return;
+        }
+
+        plies += games[i].moves.size();
+    }
+
+    Bitboard checksum = 0;
+    ChessPosition position;
+    SquareMaps maps;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < game_count; i++)
+    {
+        calculate_position(games[i].start, &position, &maps);
+        for (ChessMove move : games[i].moves)
+        {
+            ChessUndo undo;
+            make_move(&position.board, move, &undo);
+            compute_attack_maps(&position, &maps);
+            checksum += position.white_attacks ^ position.black_attacks;
+        }
+    }
+    double full_time = elapsed_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < game_count; i++)
+    {
+        calculate_position(games[i].start, &position, &maps);
+        for (ChessMove move : games[i].moves)
+        {
+            ChessUndo undo;
+            make_move(&position, &maps, move, &undo);
+            checksum += position.white_attacks ^ position.black_attacks;
+        }
+    }
+    double incremental_time = elapsed_seconds(start);
+
+    printf("attack maps: %d games, %llu plies replayed, maps verified against a full recompute\n",
+           game_count, (unsigned long long)plies);
+    printf("  full recompute %8.2f M moves/s\n", plies / full_time / 1e6);
+    printf("  incremental    %8.2f M moves/s  (%.1fx)\n", plies / incremental_time / 1e6, full_time / incremental_time);
+    printf("  (checksum %016llx)\n", (unsigned long long)checksum);
+
+    delete[] games;
+}
+
+// Every position of a few replay games, a few thousand boards of all game phases so a benchmark
+// does not run over the same eight boards again and again. nullptr if the games failed.
+static ChessState* collect_replay_states(int game_count, int* state_count)
+{
+    BenchGame* games = new BenchGame[game_count];
+    if (!generate_bench_games(games, game_count))
+    {
+        delete[] games;
+        return nullptr;
+    }
+
+    int count = 0;
+    for (int i = 0; i < game_count; i++)
+        count += games[i].moves.size() + 1;
+
+    ChessState* states = new ChessState[count];
+
+    int cursor = 0;
+    for (int i = 0; i < game_count; i++)
+    {
+        ChessState state = games[i].start;
+        states[cursor++] = state;
+        for (ChessMove move : games[i].moves)
+        {
+            ChessUndo undo;
+            make_move(&state, move, &undo);
+            states[cursor++] = state;
+        }
+    }
+
+    delete[] games;
+    *state_count = count;
+    return states;
+}
+
+static void bench_batch(int iterations)
+{
+    int state_count = 0;
+    ChessState* states = collect_replay_states(32, &state_count);
+    if (!states)
+        return;
+
+    BatchAttacks* expected = new BatchAttacks[state_count];
+    BatchAttacks* attacks = new BatchAttacks[state_count];
+
+    BatchBackend selected = active_batch_backend;
+    set_batch_backend(BatchBackend::Scalar);
+    compute_batch_attacks(states, state_count, expected);
+
+    printf("batch attacks: %d positions, %d iterations\n", state_count, iterations);
+
+    BatchBackend backends[] = { BatchBackend::Scalar, BatchBackend::Avx2 };
+    double scalar_time = 0;
+    Bitboard checksum = 0;
+
+    for (BatchBackend backend : backends)
+    {
+        if (!set_batch_backend(backend))
+        {
+            printf("  %-8s not supported by this cpu\n", batch_backend_name(backend));
+            continue;
+        }
+
+        compute_batch_attacks(states, state_count, attacks);
+        for (int i = 0; i < state_count; i++)
+        {
+            if (attacks[i].white != expected[i].white || attacks[i].black != expected[i].black)
+            {
+                log_error("%s attacks differ from the attack tables in position %d", batch_backend_name(backend), i);
+                break;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            compute_batch_attacks(states, state_count, attacks);
+            checksum += attacks[i % state_count].white;
+        }
+        double time = elapsed_seconds(start);
+        if (backend == BatchBackend::Scalar)
+            scalar_time = time;
+
+        printf("  %-8s %8.2f M positions/s  (%.1fx)\n", batch_backend_name(backend),
+               double(iterations) * state_count / time / 1e6, scalar_time / time);
+    }
+
+    set_batch_backend(selected);
+    printf("  (checksum %016llx)\n", (unsigned long long)checksum);
+
+    delete[] attacks;
+    delete[] expected;
+    delete[] states;
+}
+
+// the union over all pieces of a kind, the way evaluation wants it
+struct PieceSetAttacks {
+    Bitboard orthogonal;
+    Bitboard diagonal;
+    Bitboard knights;
+    Bitboard king;
+    Bitboard pawns;
+
+    bool operator==(const PieceSetAttacks& other) const
+    {
+        return orthogonal == other.orthogonal && diagonal == other.diagonal && knights == other.knights &&
+               king == other.king && pawns == other.pawns;
+    }
+};
+
+static PieceSetAttacks per_piece_attacks(const ChessState& state, Bitboard side, ChessColor color)
+{
+    Bitboard occupied = state.white | state.black;
+    PieceSetAttacks attacks = {};
+
+    Bitboard orthogonal = (state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen]) & side;
+    while (orthogonal)
+        attacks.orthogonal |= rook_attacks(pop_lsb(&orthogonal), occupied);
+
+    Bitboard diagonal = (state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen]) & side;
+    while (diagonal)
+        attacks.diagonal |= bishop_attacks(pop_lsb(&diagonal), occupied);
+
+    Bitboard knights = state.pieces[PieceType::Knight] & side;
+    while (knights)
+        attacks.knights |= knight_attacks(pop_lsb(&knights));
+
+    Bitboard king = state.pieces[PieceType::King] & side;
+    while (king)
+        attacks.king |= king_attacks(pop_lsb(&king));
+
+    Bitboard pawns = state.pieces[PieceType::Pawn] & side;
+    while (pawns)
+        attacks.pawns |= pawn_attacks(color, pop_lsb(&pawns));
+
+    return attacks;
+}
+
+static PieceSetAttacks setwise_attacks(const ChessState& state, Bitboard side, ChessColor color)
+{
+    Bitboard empty = ~(state.white | state.black);
+    PieceSetAttacks attacks;
+
+    attacks.orthogonal = orthogonal_fill((state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen]) & side, empty);
+    attacks.diagonal = diagonal_fill((state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen]) & side, empty);
+    attacks.knights = knight_fill(state.pieces[PieceType::Knight] & side);
+    attacks.king = king_fill(state.pieces[PieceType::King] & side);
+    attacks.pawns = pawn_fill(state.pieces[PieceType::Pawn] & side, color);
+
+    return attacks;
+}
+
+static void bench_setwise(int iterations)
+{
+    int state_count = 0;
+    ChessState* states = collect_replay_states(32, &state_count);
+    if (!states)
+        return;
+
+    for (int i = 0; i < state_count; i++)
+    {
+        if (!(per_piece_attacks(states[i], states[i].white, ChessColor::White) ==
+              setwise_attacks(states[i], states[i].white, ChessColor::White)) ||
+            !(per_piece_attacks(states[i], states[i].black, ChessColor::Black) ==
+              setwise_attacks(states[i], states[i].black, ChessColor::Black)))
+        {
+            log_error("Set-wise attacks differ from the per piece union in position %d", i);
+            delete[] states;
+            return;
+        }
+
+        Bitboard rooks = states[i].pieces[PieceType::Rook] & states[i].white;
+        Bitboard bishops = states[i].pieces[PieceType::Bishop] & states[i].white;
+        if (calculate_orthogonal_moves(rooks, states[i].white, states[i].black) !=
+                calculate_orthogonal_moves_setwise(rooks, states[i].white, states[i].black) ||
+            calculate_diagonal_moves(bishops, states[i].white, states[i].black) !=
+                calculate_diagonal_moves_setwise(bishops, states[i].white, states[i].black))
+        {
+            log_error("Set-wise moves differ from the per piece moves in position %d", i);
+            delete[] states;
+            return;
+        }
+    }
+
+    double positions = double(iterations) * state_count;
+    printf("set-wise attacks: %d positions, %d iterations, results match the per piece union\n", state_count, iterations);
+
+    Bitboard checksum = 0;
+    double slowest_time = 0;
+
+    SliderBackend selected = active_slider_backend;
+    SliderBackend backends[] = { SliderBackend::Magic, SliderBackend::Pext };
+
+    for (SliderBackend backend : backends)
+    {
+        if (!set_slider_backend(backend))
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            for (int j = 0; j < state_count; j++)
+            {
+                PieceSetAttacks white = per_piece_attacks(states[j], states[j].white, ChessColor::White);
+                PieceSetAttacks black = per_piece_attacks(states[j], states[j].black, ChessColor::Black);
+                checksum += white.orthogonal ^ white.diagonal ^ white.knights ^ white.king ^ white.pawns;
+                checksum += black.orthogonal ^ black.diagonal ^ black.knights ^ black.king ^ black.pawns;
+            }
+        }
+        double per_piece_time = elapsed_seconds(start);
+        slowest_time = MAX(slowest_time, per_piece_time);
+
+        printf("  per piece, %-6s %8.2f M positions/s\n", slider_backend_name(backend), positions / per_piece_time / 1e6);
+    }
+
+    set_slider_backend(selected);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int j = 0; j < state_count; j++)
+        {
+            PieceSetAttacks white = setwise_attacks(states[j], states[j].white, ChessColor::White);
+            PieceSetAttacks black = setwise_attacks(states[j], states[j].black, ChessColor::Black);
+            checksum += white.orthogonal ^ white.diagonal ^ white.knights ^ white.king ^ white.pawns;
+            checksum += black.orthogonal ^ black.diagonal ^ black.knights ^ black.king ^ black.pawns;
+        }
+    }
+    double setwise_time = elapsed_seconds(start);
+
+    printf("  occluded fill     %8.2f M positions/s  (%.1fx over the slowest)\n", positions / setwise_time / 1e6,
+           slowest_time / setwise_time);
+    printf("  (checksum %016llx)\n", (unsigned long long)checksum);
+
+    delete[] states;
+}
+
+static bool same_position(const ChessState& a, const ChessState& b)
+{
+    return a.white == b.white && a.black == b.black && memcmp(a.pieces, b.pieces, sizeof(a.pieces)) == 0 &&
+           memcmp(a.mailbox, b.mailbox, sizeof(a.mailbox)) == 0 && a.castling == b.castling &&
+           a.en_passant_square == b.en_passant_square && a.side_to_move == b.side_to_move &&
+           a.half_move == b.half_move && a.move_clock == b.move_clock && a.hash == b.hash;
+}
+
+// Writes an epd file of the replay positions with the fen serializer, maps it and reads it back.
+static void bench_epd(int line_count)
+{
+    const char* path = "bench.epd";
+
+    int state_count = 0;
+    ChessState* states = collect_replay_states(32, &state_count);
+    if (!states)
+        return;
+
+    // lines the reader has to skip and count as errors, they must never turn into a record
+    const char* rejected_fens[] = {
+        "4k3/8/8/8/8/8/3P4/4K3 w - e3 0 1",  // en passant square with no pawn that made the push
+        "8/8/8/8/8/8/8/8 w - - 0 1",         // no kings
+    };
+
+    FILE* out = fopen(path, "wb");
+    if (!out)
+    {
+        log_error("Could not create %s", path);
+        delete[] states;
+        return;
+    }
+
+    s64 bytes = 0;
+    double write_time = 0;
+    {
+        char line[MAX_FEN_LENGTH + 64];
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < line_count; i++)
+        {
+            int length = write_fen(states[i % state_count], line);
+            length += snprintf(line + length, sizeof(line) - length, " bm Nf3; id \"bench.%d\"; c0 \"a; b\";\n", i);
+            fwrite(line, 1, length, out);
+            bytes += length;
+        }
+        for (const char* fen : rejected_fens)
+        {
+            int length = snprintf(line, sizeof(line), "%s bm Nf3;\n", fen);
+            fwrite(line, 1, length, out);
+            bytes += length;
+        }
+        fclose(out);
+        write_time = elapsed_seconds(start);
+    }
+
+    MappedFile file;
+    if (!map_file(path, &file))
+    {
+        log_error("Could not map %s", path);
+        delete[] states;
+        return;
+    }
+
+    EpdReader reader;
+    EpdRecord record;
+    int mismatches = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    reader.open(file.data, file.size);
+    int read = 0;
+    u64 checksum = 0;
+    while (reader.next(&record))
+    {
+        checksum += record.state.hash + record.id.size + record.best_moves.size;
+        read += 1;
+    }
+    double read_time = elapsed_seconds(start);
+
+    // checked in a separate pass so the comparison does not count as parsing time
+    reader.open(file.data, file.size);
+    for (int i = 0; reader.next(&record); i++)
+    {
+        char id[32];
+        snprintf(id, sizeof(id), "bench.%d", i);
+        if (i >= line_count || !same_position(record.state, states[i % state_count]) || !(record.id == make_string(id)) ||
+            !(record.best_moves == make_string("Nf3")) || !(record.comment == make_string("a; b")))
+        {
+            mismatches += 1;
+        }
+    }
+    if (reader.errors != int(ARRAY_SIZE(rejected_fens)))
+        mismatches += 1;
+
+    printf("epd: %d lines, %.1f MB\n", line_count, bytes / 1e6);
+    printf("  write_fen  %8.2f M lines/s\n", line_count / write_time / 1e6);
+    printf("  read       %8.2f M lines/s  %.0f MB/s  %d read, %d errors, %d mismatches\n", read / read_time / 1e6,
+           bytes / read_time / 1e6, read, reader.errors, mismatches);
+    printf("  (checksum %016llx)\n", (unsigned long long)checksum);
+
+    unmap_file(&file);
+    remove(path);
+    delete[] states;
+}
+
+// is_square_attacked against masking the full attackers_to set, every square for both colors,
+// then the single king square in_check asks about
+static void bench_attacked(int iterations)
+{
+    int state_count = 0;
+    ChessState* states = collect_replay_states(32, &state_count);
+    if (!states)
+        return;
+
+    for (int i = 0; i < state_count; i++)
+    {
+        const ChessState& state = states[i];
+        Bitboard occupied = state.white | state.black;
+        for (int square = 0; square < 64; square++)
+        {
+            Bitboard attackers = attackers_to(state, square, occupied);
+            if (is_square_attacked(state, square, ChessColor::White) != ((attackers & state.white) != 0) ||
+                is_square_attacked(state, square, ChessColor::Black) != ((attackers & state.black) != 0))
+            {
+                log_error("is_square_attacked disagrees with attackers_to on %s in position %d", square_identifier_string(square), i);
+                delete[] states;
+                return;
+            }
+        }
+    }
+
+    u64 queries = u64(iterations) * state_count * 64 * 2;
+    printf("square attacked: %d positions, %d iterations, %llu queries\n", state_count, iterations, (unsigned long long)queries);
+
+    u64 attacked = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < state_count; i++)
+        {
+            const ChessState& state = states[i];
+            Bitboard occupied = state.white | state.black;
+            for (int square = 0; square < 64; square++)
+            {
+                attacked += (attackers_to(state, square, occupied) & state.white) != 0;
+                attacked += (attackers_to(state, square, occupied) & state.black) != 0;
+            }
+        }
+    }
+    double full_time = elapsed_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < state_count; i++)
+        {
+            for (int square = 0; square < 64; square++)
+            {
+                attacked += is_square_attacked(states[i], square, ChessColor::White);
+                attacked += is_square_attacked(states[i], square, ChessColor::Black);
+            }
+        }
+    }
+    double early_time = elapsed_seconds(start);
+
+    printf("  attackers_to       %8.2f M queries/s\n", queries / full_time / 1e6);
+    printf("  is_square_attacked %8.2f M queries/s  (%.2fx)\n", queries / early_time / 1e6, full_time / early_time);
+    printf("  (%llu attacked)\n", (unsigned long long)attacked);
+
+    // The query in_check makes at every search node: one square, the king of the side to move,
+    // which is rarely attacked so the early exit almost never fires.
+    int king_iterations = iterations * 64;
+    u64 king_queries = u64(king_iterations) * state_count;
+    printf("king in check: %llu queries\n", (unsigned long long)king_queries);
+
+    u64 checks = 0;
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < king_iterations; n++)
+    {
+        for (int i = 0; i < state_count; i++)
+        {
+            const ChessState& state = states[i];
+            bool white = state.side_to_move == ChessColor::White;
+            Bitboard king = state.pieces[PieceType::King] & (white ? state.white : state.black);
+            Bitboard attackers = attackers_to(state, TRAILING_ZEROS(king), state.white | state.black);
+            checks += (attackers & (white ? state.black : state.white)) != 0;
+        }
+    }
+    double king_full_time = elapsed_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < king_iterations; n++)
+    {
+        for (int i = 0; i < state_count; i++)
+        {
+            const ChessState& state = states[i];
+            bool white = state.side_to_move == ChessColor::White;
+            Bitboard king = state.pieces[PieceType::King] & (white ? state.white : state.black);
+            checks += is_square_attacked(state, TRAILING_ZEROS(king), white ? ChessColor::Black : ChessColor::White);
+        }
+    }
+    double king_early_time = elapsed_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < king_iterations; n++)
+    {
+        for (int i = 0; i < state_count; i++)
+        {
+            checks += in_check(states[i]);
+        }
+    }
+    double in_check_time = elapsed_seconds(start);
+
+    printf("  attackers_to       %8.2f M queries/s\n", king_queries / king_full_time / 1e6);
+    printf("  is_square_attacked %8.2f M queries/s  (%.2fx)\n", king_queries / king_early_time / 1e6, king_full_time / king_early_time);
+    printf("  in_check           %8.2f M queries/s  (%.2fx)\n", king_queries / in_check_time / 1e6, king_full_time / in_check_time);
+    printf("  (%llu checks)\n", (unsigned long long)checks);
+
+    delete[] states;
+}
+
+// see and see_ge on every capture of the replay positions, checked against each other first
+static void bench_see(int iterations)
+{
+    int state_count = 0;
+    ChessState* states = collect_replay_states(32, &state_count);
+    if (!states)
+        return;
+
+    // one capture list per position, flat so the timed loops only walk memory
+    ChessMove* captures = new ChessMove[state_count * MAX_MOVES];
+    int* capture_counts = new int[state_count];
+    int total = 0;
+    for (int i = 0; i < state_count; i++)
+    {
+        capture_counts[i] = generate_captures(states[i], captures + i * MAX_MOVES);
+        total += capture_counts[i];
+    }
+
+    for (int i = 0; i < state_count; i++)
+    {
+        for (int j = 0; j < capture_counts[i]; j++)
+        {
+            ChessMove move = captures[i * MAX_MOVES + j];
+            int value = see(states[i], move);
+            if (!see_ge(states[i], move, value) || see_ge(states[i], move, value + 1))
+            {
+                log_error("see_ge disagrees with see = %d on %s%s in position %d", value,
+                          square_identifier_string(move.from()), square_identifier_string(move.to()), i);
+                break;
+            }
+        }
+    }
+
+    printf("static exchange: %d positions, %d captures, %d iterations\n", state_count, total, iterations);
+
+    long long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < state_count; i++)
+            for (int j = 0; j < capture_counts[i]; j++)
+                sum += see(states[i], captures[i * MAX_MOVES + j]);
+    double see_time = elapsed_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < state_count; i++)
+            for (int j = 0; j < capture_counts[i]; j++)
+                sum += see_ge(states[i], captures[i * MAX_MOVES + j], 0);
+    double ge_time = elapsed_seconds(start);
+
+    double calls = double(iterations) * total;
+    printf("  see        %8.2f M calls/s\n", calls / see_time / 1e6);
+    printf("  see_ge(0)  %8.2f M calls/s  (%.2fx)\n", calls / ge_time / 1e6, see_time / ge_time);
+    printf("  (checksum %lld)\n", sum);
+
+    delete[] capture_counts;
+    delete[] captures;
+    delete[] states;
+}
+
+// Lazy smp time to depth and nodes per second over the bench positions, for 1, 2, 4 .. threads
+// up to the core count. Every position starts from a cleared table so runs do not help each other.
+static void bench_smp(int depth)
+{
+    ChessState states[ARRAY_SIZE(BenchPositions)];
+    if (!load_bench_positions(states, ARRAY_SIZE(BenchPositions)))
+        return;
+
+    TranspositionTable table;
+    if (!table.resize(64))
+    {
+        log_error("Could not allocate the transposition table");
+        return;
+    }
+
+    int max_threads = MAX(int(std::thread::hardware_concurrency()), 1);
+    printf("lazy smp: %d positions to depth %d, up to %d threads\n", int(ARRAY_SIZE(BenchPositions)), depth, max_threads);
+    printf("  threads   time to depth  speed-up      Mnps  nps scaling\n");
+
+    double single_seconds = 0;
+    double single_nps = 0;
+    for (int threads = 1; ; threads = MIN(threads * 2, max_threads))
+    {
+        u64 nodes = 0;
+        double seconds = 0;
+        for (const ChessState& state : states)
+        {
+            table.clear();
+            table.new_search();
+
+            ParallelSearch search;
+            search.thread_count = threads;
+            search.limits.depth = depth;
+            search.table = &table;
+
+            auto start = std::chrono::steady_clock::now();
+            search.run(state, KeyHistory());
+            seconds += elapsed_seconds(start);
+            nodes += search.total_nodes;
+        }
+
+        double nps = nodes / seconds;
+        if (threads == 1)
+        {
+            single_seconds = seconds;
+            single_nps = nps;
+        }
+
+        printf("  %7d   %11.3f s  %7.2fx  %8.2f  %10.2fx\n", threads, seconds, single_seconds / seconds,
+               nps / 1e6, nps / single_nps);
+
+        if (threads == max_threads)
+            break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <sliders|attack-maps|batch|setwise|epd|attacked|see|smp> [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    String name = String(argv[1]);
+
+    int iterations = 0;
+    if (argc > 2)
+    {
+        bool success = false;
+        iterations = string_to_integer(String(argv[2]), &success);
+        if (!success || iterations <= 0)
+        {
+            log_error("Invalid iteration count %s", argv[2]);
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    initialize_attack_tables();
+    printf("attack tables initialized in %.2f ms, slider backend: %s\n",
+           elapsed_seconds(start) * 1000.0, slider_backend_name(active_slider_backend));
+
+    if (string_compare(name, make_string("sliders")))
+    {
+        bench_sliders(iterations ? iterations : 200000);
+    }
+    else if (string_compare(name, make_string("attack-maps")))
+    {
+        bench_attack_maps(iterations ? iterations : 2000);
+    }
+    else if (string_compare(name, make_string("batch")))
+    {
+        bench_batch(iterations ? iterations : 500);
+    }
+    else if (string_compare(name, make_string("setwise")))
+    {
+        bench_setwise(iterations ? iterations : 500);
+    }
+    else if (string_compare(name, make_string("epd")))
+    {
+        bench_epd(iterations ? iterations : 1000000);
+    }
+    else if (string_compare(name, make_string("attacked")))
+    {
+        bench_attacked(iterations ? iterations : 200);
+    }
+    else if (string_compare(name, make_string("see")))
+    {
+        bench_see(iterations ? iterations : 500);
+    }
+    else if (string_compare(name, make_string("smp")))
+    {
+        bench_smp(iterations ? iterations : 8);
+    }
+    else
+    {
+        log_error("Unknown benchmark %s", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
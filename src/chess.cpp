@@ -1,9 +1,10 @@
 #include "chess.hpp"
+#include "attack_tables.hpp"
 #include "log.hpp"
 
 Bitboard board_position_to_bitboard(BoardPosition pos)
 {
-    return pos.column + pos.row * 8;
+    return BIT(pos.column + pos.row * 8);
 }
 
 BoardPosition index_to_board_position(SquareIndex index)
@@ -16,490 +17,1718 @@ SquareIndex board_position_to_index(BoardPosition pos)
     return pos.row * 8 + pos.column;
 }
 
-bool parse_fen_string(ChessState* state, String fen)
+struct ZobristKeys {
+    u64 pieces[2][PieceType::Count][64];  // indexed by ChessColor
+    u64 castling[16];
+    u64 en_passant_file[8];
+    u64 side;  // black to move
+};
+
+static constexpr ZobristKeys make_zobrist_keys()
+{
+    ZobristKeys keys = {};
+
+    // splitmix64 with a fixed seed, the keys are the same for every build
+    u64 seed = 0x1d872b41c6ee9b37ull;
+    auto next = [&seed]() {
+        seed += 0x9e3779b97f4a7c15ull;
+        u64 z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    };
+
+    for (int color = 0; color < 2; color++)
+        for (int type = 0; type < PieceType::Count; type++)
+            for (int square = 0; square < 64; square++)
+                keys.pieces[color][type][square] = next();
+
+    // no rights hashes to zero like an empty board
+    for (int i = 1; i < 16; i++)
+        keys.castling[i] = next();
+
+    for (int i = 0; i < 8; i++)
+        keys.en_passant_file[i] = next();
+
+    keys.side = next();
+
+    return keys;
+}
+
+static constexpr ZobristKeys Zobrist = make_zobrist_keys();
+
+u64 compute_hash(const ChessState& state)
+{
+    u64 hash = 0;
+
+    for (int type = 0; type < PieceType::Count; type++)
+    {
+        Bitboard white = state.pieces[type] & state.white;
+        Bitboard black = state.pieces[type] & state.black;
+        while (white)
+            hash ^= Zobrist.pieces[int(ChessColor::White)][type][pop_lsb(&white)];
+        while (black)
+            hash ^= Zobrist.pieces[int(ChessColor::Black)][type][pop_lsb(&black)];
+    }
+
+    hash ^= Zobrist.castling[state.castling];
+
+    if (state.en_passant_square != NullSquareIndex)
+        hash ^= Zobrist.en_passant_file[state.en_passant_square % 8];
+
+    if (state.side_to_move == ChessColor::Black)
+        hash ^= Zobrist.side;
+
+    return hash;
+}
+
+// whether a pawn of the given color stands next to the double pushed pawn and could take it
+static bool can_capture_en_passant(const ChessState& state, SquareIndex square, ChessColor capturer)
 {
+    ChessColor pusher = opposite_color(capturer);
+    Bitboard capturers = state.pieces[PieceType::Pawn] & (capturer == ChessColor::White ? state.white : state.black);
+
+    return (pawn_attacks(pusher, square) & capturers) != 0;
+}
+
+// What a character of the placement field means, looked up once instead of branching on it.
+// Pieces are (color << 3) | type, the same packing as Piece.
+enum FenCode : u8 {
+    FenEmpty1 = 0x10,  // one to eight empty squares, FenEmpty1 + n - 1
+    FenRowEnd = 0x20,
+    FenInvalid = 0xff,
+};
+
+struct FenCodeTable {
+    u8 codes[256];
+};
+
+static constexpr FenCodeTable make_fen_codes()
+{
+    FenCodeTable table = {};
+    for (int i = 0; i < 256; i++)
+        table.codes[i] = FenInvalid;
+
+    const char* pieces = "kqrbnp";
+    for (int type = 0; type < PieceType::Count; type++)
+    {
+        table.codes[u8(pieces[type] - 'a' + 'A')] = u8(type);
+        table.codes[u8(pieces[type])] = u8(8 | type);
+    }
+
+    for (int n = 1; n <= 8; n++)
+        table.codes['0' + n] = u8(FenEmpty1 + n - 1);
+
+    table.codes[u8('/')] = FenRowEnd;
+    return table;
+}
+
+static constexpr FenCodeTable FenCodes = make_fen_codes();
+
+static inline bool parse_fen_number(String text, int* cursor, int* result)
+{
+    int start = *cursor;
+    int value = 0;
+    while (*cursor < text.size && is_digit(text[*cursor]) && *cursor - start < 9)
+    {
+        value = value * 10 + (text[*cursor] - '0');
+        *cursor += 1;
+    }
+
+    *result = value;
+    return *cursor > start;
+}
+
+bool parse_fen_fields(String text, ChessState* state, int* consumed)
+{
+    *state = ChessState();
+
+    Bitboard* sides[2] = { &state->white, &state->black };
+
     int cursor = 0;
+    int square = 56;  // a8, the placement starts at the top left
+    int row_start = 56;
 
-    if (fen.size < 25)  // shortest possible fen string
+    while (cursor < text.size && text[cursor] != ' ')
+    {
+        u8 code = FenCodes.codes[u8(text[cursor++])];
+
+        if (code < FenEmpty1)
+        {
+            if (square >= row_start + 8)
+                return false;
+
+            PieceType type = PieceType(code & 7);
+            *sides[code >> 3] |= BIT(square);
+            state->pieces[type] |= BIT(square);
+            state->set_piece_on(square, type);
+            square += 1;
+        }
+        else if (code < FenRowEnd)
+        {
+            square += code - FenEmpty1 + 1;
+            if (square > row_start + 8)
+                return false;
+        }
+        else if (code == FenRowEnd && square == row_start + 8 && row_start > 0)
+        {
+            row_start -= 8;
+            square = row_start;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (square != 8 || row_start != 0)
+        return false;
+
+    // the move code needs exactly one king per side, none or several is not a position it can handle
+    Bitboard kings = state->pieces[PieceType::King];
+    if (POP_COUNT(kings & state->white) != 1 || POP_COUNT(kings & state->black) != 1)
         return false;
 
-#define ADVANCE()   \
-    do { cursor += 1; if (cursor >= fen.size) return false; } while(0)
+    if (cursor + 2 > text.size)
+        return false;
 
-    int row = 7;
-    while (row >= 0)
+    switch (text[cursor + 1])
     {
-        int column = 0;
-        while (column < 8)
+        case 'w': state->side_to_move = ChessColor::White; break;
+        case 'b': state->side_to_move = ChessColor::Black; break;
+        default: return false;
+    }
+    cursor += 2;
+
+    if (cursor + 2 > text.size || text[cursor] != ' ')
+        return false;
+    cursor += 1;
+
+    if (text[cursor] == '-')
+    {
+        cursor += 1;
+    }
+    else
+    {
+        // in KQkq order, each at most once
+        int last = -1;
+        while (cursor < text.size && text[cursor] != ' ')
         {
-            if (is_digit(fen[cursor]))
+            int right;
+            switch (text[cursor])
             {
-                int n = fen[cursor] - '0';
-                if (column + n > 8)
-                {
-                    return false;
-                }
+                case 'K': right = 0; break;
+                case 'Q': right = 1; break;
+                case 'k': right = 2; break;
+                case 'q': right = 3; break;
+                default: return false;
+            }
+            if (right <= last)
+                return false;
+
+            state->castling |= u8(1 << right);
+            last = right;
+            cursor += 1;
+        }
+
+        if (last < 0)
+            return false;
+    }
+
+    if (cursor + 2 > text.size || text[cursor] != ' ')
+        return false;
+    cursor += 1;
+
+    if (text[cursor] == '-')
+    {
+        cursor += 1;
+    }
+    else
+    {
+        if (cursor + 2 > text.size)
+            return false;
+
+        SquareIndex square = parse_square(text[cursor + 1], text[cursor]);
+        if (square == NullSquareIndex)
+            return false;
+
+        // The square the other side's pawn skipped, make_move trusts it to be one: on the sixth
+        // row for white, the third for black, empty along with the square the pawn left, and the
+        // pawn right in front of it.
+        bool white = state->side_to_move == ChessColor::White;
+        int push = white ? 8 : -8;
+        Bitboard occupied = state->white | state->black;
+        Bitboard pushers = state->pieces[PieceType::Pawn] & (white ? state->black : state->white);
+        if (square / 8 != (white ? 5 : 2) || (occupied & (BIT(square) | BIT(square + push))) ||
+            !(pushers & BIT(square - push)))
+        {
+            return false;
+        }
+
+        state->en_passant_square = square;
+        cursor += 2;
+    }
+
+    // the clocks are missing in epd, there the next field is an opcode
+    state->move_clock = 1;
+    if (cursor + 1 < text.size && text[cursor] == ' ' && is_digit(text[cursor + 1]))
+    {
+        int after_half_move = cursor + 1;
+        int half_move = 0, move_clock = 0;
+        parse_fen_number(text, &after_half_move, &half_move);
+
+        int after_move_clock = after_half_move + 1;
+        if (after_half_move < text.size && text[after_half_move] == ' ' &&
+            parse_fen_number(text, &after_move_clock, &move_clock))
+        {
+            // the clocks are 16 bits in the state, a larger one would wrap to something else
+            if (half_move > 0xffff || move_clock > 0xffff)
+                return false;
+
+            state->half_move = u16(half_move);
+            state->move_clock = u16(move_clock);
+            cursor = after_move_clock;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (state->en_passant_square != NullSquareIndex &&
+        !can_capture_en_passant(*state, state->en_passant_square, state->side_to_move))
+    {
+        state->en_passant_square = NullSquareIndex;
+    }
+
+    state->hash = compute_hash(*state);
+    *consumed = cursor;
 
-                column += n;
+    return true;
+}
+
+bool parse_fen_string(ChessState* state, String fen)
+{
+    int consumed = 0;
+    if (!parse_fen_fields(fen, state, &consumed))
+        return false;
+
+    // nothing but whitespace may follow
+    while (consumed < fen.size && (fen[consumed] == ' ' || fen[consumed] == '\n' || fen[consumed] == '\r'))
+        consumed += 1;
+
+    return consumed == fen.size;
+}
+
+static const char FenPieceCharacters[2][8] = {
+    { 'K', 'Q', 'R', 'B', 'N', 'P', '?', '?' },
+    { 'k', 'q', 'r', 'b', 'n', 'p', '?', '?' },
+};
+
+static inline char* write_fen_number(char* out, u32 value)
+{
+    char digits[10];
+    int count = 0;
+    do
+    {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    while (count)
+        *out++ = digits[--count];
+
+    return out;
+}
+
+int write_fen(const ChessState& state, char buffer[MAX_FEN_LENGTH])
+{
+    char* out = buffer;
+
+    for (int row = 7; row >= 0; row--)
+    {
+        int empty = 0;
+        for (int square = row * 8; square < row * 8 + 8; square++)
+        {
+            PieceType type = state.piece_on(square);
+            if (type == PieceType::Sentinel)
+            {
+                empty += 1;
+                continue;
             }
-            else if (is_alpha_upper(fen[cursor]))
+
+            if (empty)
             {
-                PieceType type;
+                *out++ = char('0' + empty);
+                empty = 0;
+            }
+            *out++ = FenPieceCharacters[(state.black >> square) & 1][type];
+        }
 
-                switch (fen[cursor])
-                {
-                case 'K':
-                    type = PieceType::King;
-                    break;
-                case 'Q':
-                    type = PieceType::Queen;
-                    break;
-                case 'R':
-                    type = PieceType::Rook;
-                    break;
-                case 'B':
-                    type = PieceType::Bishop;
-                    break;
-                case 'N':
-                    type = PieceType::Knight;
-                    break;
-                case 'P':
-                    type = PieceType::Pawn;
-                    break;
-                default:
-                    return false;
-                }
+        if (empty)
+            *out++ = char('0' + empty);
+        if (row)
+            *out++ = '/';
+    }
+
+    *out++ = ' ';
+    *out++ = state.side_to_move == ChessColor::White ? 'w' : 'b';
+    *out++ = ' ';
+
+    if (!state.castling)
+        *out++ = '-';
+    if (state.castling & WhiteKingSide)  *out++ = 'K';
+    if (state.castling & WhiteQueenSide) *out++ = 'Q';
+    if (state.castling & BlackKingSide)  *out++ = 'k';
+    if (state.castling & BlackQueenSide) *out++ = 'q';
+
+    *out++ = ' ';
+    if (state.en_passant_square == NullSquareIndex)
+    {
+        *out++ = '-';
+    }
+    else
+    {
+        *out++ = char('a' + state.en_passant_square % 8);
+        *out++ = char('1' + state.en_passant_square / 8);
+    }
+
+    *out++ = ' ';
+    out = write_fen_number(out, state.half_move);
+    *out++ = ' ';
+    out = write_fen_number(out, state.move_clock);
+    *out = '\0';
+
+    return int(out - buffer);
+}
+
+bool ChessGame::make_move(SquareIndex from, SquareIndex to)
+{
+    ChessMove move = find_move(legal_moves, from, to);
+    if (move.is_null())
+    {
+        return false;
+    }
+
+    if (moves.is_full())
+    {
+        log_warning("Game history is full, no more moves can be played");
+        return false;
+    }
+
+    ChessUndo undo;
+    key_history.add(position.board.hash);
+    ::make_move(&position, &maps, move, &undo);
+    moves.add(move);
+    undo_stack.add(undo);
+    redo_count = 0;
 
-                state->put_piece(type, ChessColor::White, BoardPosition(row, column));
-                column += 1;
+    calculate_moves();
+    return true;
+}
+
+bool ChessGame::undo_move()
+{
+    if (!moves.size()) return false;
+
+    ::unmake_move(&position, &maps, moves.pop(), undo_stack.pop());
+    key_history.pop();
+    redo_count += 1;
+
+    calculate_moves();
+    return true;
+}
+
+bool ChessGame::redo_move()
+{
+    if (!redo_count) return false;
+
+    // undo_move only shrinks the history, the move is still stored right past its end
+    ChessMove move = moves.data()[moves.size()];
+
+    ChessUndo undo;
+    key_history.add(position.board.hash);
+    ::make_move(&position, &maps, move, &undo);
+    moves.add(move);
+    undo_stack.add(undo);
+    redo_count -= 1;
+
+    calculate_moves();
+    return true;
+}
+
+bool ChessGame::set_position(const ChessState& state)
+{
+    position = {};
+    position.board = state;
+    position.board.hash = compute_hash(state);
+    moves.clear();
+    undo_stack.clear();
+    key_history.clear();
+    redo_count = 0;
+
+    compute_attack_maps(&position, &maps);
+    calculate_moves();
+
+    return true;
+}
+
+bool ChessGame::is_draw() const
+{
+    const ChessState& state = position.board;
+    if (legal_moves.is_empty() && in_check(state))
+        return false;
+
+    return is_threefold_repetition(state, key_history) || is_fifty_move_draw(state) || has_insufficient_material(state);
+}
+
+// How often the current key shows up in the reachable part of the history, stopping at limit.
+// The side to move alternates, so only every second key can match, and the first candidate is
+// four plies back since both sides need two moves to undo each other.
+static int count_repetitions(const ChessState& state, const KeyHistory& history, int limit)
+{
+    int reachable = MIN(int(state.half_move), history.size());
+    const u64* keys = history.data() + history.size();
+
+    int count = 0;
+    for (int back = 4; back <= reachable; back += 2)
+    {
+        if (keys[-back] == state.hash && ++count >= limit)
+            break;
+    }
+    return count;
+}
+
+bool is_repetition(const ChessState& state, const KeyHistory& history)
+{
+    return count_repetitions(state, history, 1) >= 1;
+}
+
+bool is_threefold_repetition(const ChessState& state, const KeyHistory& history)
+{
+    return count_repetitions(state, history, 2) >= 2;
+}
+
+bool is_fifty_move_draw(const ChessState& state)
+{
+    return state.half_move >= 100;
+}
+
+bool has_insufficient_material(const ChessState& state)
+{
+    if (state.pieces[PieceType::Pawn] | state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen])
+        return false;
+
+    Bitboard knights = state.pieces[PieceType::Knight];
+    Bitboard bishops = state.pieces[PieceType::Bishop];
+    if (POP_COUNT(knights | bishops) <= 1)
+        return true;
+
+    // a1 is dark, squares where row and column add up to an even number share its color
+    constexpr Bitboard DarkSquares = 0xaa55aa55aa55aa55ull;
+    return !knights && (!(bishops & DarkSquares) || !(bishops & ~DarkSquares));
+}
+
+void ChessGame::calculate_moves()
+{
+    generate_legal_moves(position.board, &legal_moves);
+
+    for (Bitboard& square_moves : maps.moves)
+    {
+        square_moves = 0;
+    }
+
+    // only the side to move has any moves
+    Bitboard targets = 0;
+    for (ChessMove move : legal_moves)
+    {
+        maps.moves[move.from()] |= BIT(move.to());
+        targets |= BIT(move.to());
+    }
+
+    position.white_moves = position.board.side_to_move == ChessColor::White ? targets : 0;
+    position.black_moves = position.board.side_to_move == ChessColor::Black ? targets : 0;
+}
+
+void ChessState::put_piece(PieceType type, ChessColor color, SquareIndex index)
+{
+    Bitboard square = BIT(index);
+
+    if (type == PieceType::King) {
+        Bitboard white_king = white & pieces[PieceType::King];
+        Bitboard black_king = black & pieces[PieceType::King];
+        if ((color == ChessColor::White &&
+             white_king != 0 &&
+             white_king != square) ||
+            (color == ChessColor::Black &&
+             black_king != 0 &&
+             black_king != square)
+            )
+        {
+            log_warning("Trying to place more than one king on the board");
+            return;
+        }
+    }
+
+    if (color == ChessColor::White)
+    {
+        white |= square;
+    }
+    else if (color == ChessColor::Black)
+    {
+        black |= square;
+    }
+
+    pieces[type] |= square;
+    set_piece_on(index, type);
+}
+
+void ChessState::put_piece(PieceType type, ChessColor color, BoardPosition position)
+{
+    put_piece(type, color, board_position_to_index(position));
+}
+
+void ChessState::clear_square(SquareIndex index)
+{
+    Bitboard c = ~BIT(index);
+    white &= c;
+    black &= c;
+    for (int i = 0; i < PieceType::Count; i++)
+    {
+        pieces[i] &= c;
+    }
+    set_piece_on(index, PieceType::Sentinel);
+}
+
+void calculate_position(const ChessState& state, ChessPosition* position, SquareMaps* maps)
+{
+    *position = {};
+    position->board = state;
+    compute_attack_maps(position, maps);
+}
+
+SliderMagic rook_magics[64];
+SliderMagic bishop_magics[64];
+
+// sum over squares of 2^popcount(mask)
+static Bitboard rook_attack_table[0x19000];
+static Bitboard bishop_attack_table[0x1480];
+
+static const int RookDirections[4][2]   = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+static const int BishopDirections[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+
+// slow ray walk, only used to fill the tables
+static Bitboard sliding_attacks(SquareIndex square, Bitboard occupied, const int directions[4][2])
+{
+    Bitboard attacks = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        int row    = square / 8 + directions[i][0];
+        int column = square % 8 + directions[i][1];
+
+        while (row >= 0 && row < 8 && column >= 0 && column < 8)
+        {
+            Bitboard m = BIT(row * 8 + column);
+            attacks |= m;
+            if (m & occupied)
+            {
+                break;
+            }
+
+            row    += directions[i][0];
+            column += directions[i][1];
+        }
+    }
+
+    return attacks;
+}
+
+// xorshift64*, fixed seeds so the magics come out the same on every run
+struct MagicRandom {
+    u64 state;
+
+    u64 next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ull;
+    }
+
+    // magics with few set bits are found much faster
+    u64 sparse()
+    {
+        return next() & next() & next();
+    }
+};
+
+static void initialize_slider_masks(SliderMagic magics[64], Bitboard* table, const int directions[4][2])
+{
+    Bitboard* cursor = table;
+
+    for (int square = 0; square < 64; square++)
+    {
+        int row = square / 8;
+        int column = square % 8;
+
+        // the board edges never change the attack set unless the slider is standing on them
+        Bitboard rank_edges = (0xffull | (0xffull << 56)) & ~(0xffull << (row * 8));
+        Bitboard file_edges = (0x0101010101010101ull | (0x0101010101010101ull << 7)) & ~(0x0101010101010101ull << column);
+
+        SliderMagic& m = magics[square];
+        m.mask = sliding_attacks(square, 0, directions) & ~(rank_edges | file_edges);
+        m.shift = 64 - POP_COUNT(m.mask);
+        m.attacks = cursor;
+
+        cursor += BIT(POP_COUNT(m.mask));
+    }
+}
+
+// searches magic numbers with no destructive collisions, uses the table as scratch space
+static void find_slider_magics(SliderMagic magics[64], const int directions[4][2])
+{
+    static const u64 seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+
+    static Bitboard occupancy[4096];
+    static Bitboard reference[4096];
+    static int epoch[4096];
+    static int attempt = 0;  // epoch outlives a single call so the counter must too
+
+    for (int square = 0; square < 64; square++)
+    {
+        SliderMagic& m = magics[square];
+
+        // enumerate every subset of the mask (carry-rippler)
+        int size = 0;
+        Bitboard subset = 0;
+        do
+        {
+            occupancy[size] = subset;
+            reference[size] = sliding_attacks(square, subset, directions);
+            size += 1;
+            subset = (subset - m.mask) & m.mask;
+        } while (subset);
+
+        MagicRandom random = { seeds[square / 8] };
+
+        for (int i = 0; i < size; )
+        {
+            for (m.magic = 0; POP_COUNT((m.magic * m.mask) >> 56) < 6; )
+            {
+                m.magic = random.sparse();
             }
-            else if (is_alpha_lower(fen[cursor]))
+
+            attempt += 1;
+            for (i = 0; i < size; i++)
             {
-                PieceType type;
+                u32 index = u32(((occupancy[i] & m.mask) * m.magic) >> m.shift);
 
-                switch (fen[cursor])
+                if (epoch[index] < attempt)
+                {
+                    epoch[index] = attempt;
+                    m.attacks[index] = reference[i];
+                }
+                else if (m.attacks[index] != reference[i])
                 {
-                case 'k':
-                    type = PieceType::King;
-                    break;
-                case 'q':
-                    type = PieceType::Queen;
-                    break;
-                case 'r':
-                    type = PieceType::Rook;
-                    break;
-                case 'b':
-                    type = PieceType::Bishop;
-                    break;
-                case 'n':
-                    type = PieceType::Knight;
-                    break;
-                case 'p':
-                    type = PieceType::Pawn;
                     break;
-                default:
-                    return false;
                 }
+            }
+        }
+    }
+}
+
+// fills the tables in the layout of the active backend
+static void fill_slider_tables(SliderMagic magics[64], const int directions[4][2])
+{
+    for (int square = 0; square < 64; square++)
+    {
+        SliderMagic& m = magics[square];
+
+        Bitboard subset = 0;
+        do
+        {
+            m.attacks[m.index(subset)] = sliding_attacks(square, subset, directions);
+            subset = (subset - m.mask) & m.mask;
+        } while (subset);
+    }
+}
+
+Bitboard between_squares[64][64];
+Bitboard line_squares[64][64];
 
-                state->put_piece(type, ChessColor::Black, BoardPosition(row, column));
-                column += 1;
+static void initialize_line_tables()
+{
+    for (int a = 0; a < 64; a++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            between_squares[a][b] = 0;
+            line_squares[a][b] = 0;
+
+            if (a == b)
+                continue;
+
+            // rays through a and b in the other directions are parallel, so the intersections only keep the shared line
+            if (rook_attacks(a, 0) & BIT(b))
+            {
+                line_squares[a][b] = (rook_attacks(a, 0) & rook_attacks(b, 0)) | BIT(a) | BIT(b);
+                between_squares[a][b] = rook_attacks(a, BIT(b)) & rook_attacks(b, BIT(a));
             }
-            else if (fen[cursor] == '/')
+            else if (bishop_attacks(a, 0) & BIT(b))
             {
-                if (column != 0 && row != 7)
-                {
-                    return false;
-                }
+                line_squares[a][b] = (bishop_attacks(a, 0) & bishop_attacks(b, 0)) | BIT(a) | BIT(b);
+                between_squares[a][b] = bishop_attacks(a, BIT(b)) & bishop_attacks(b, BIT(a));
             }
-
-            ADVANCE();
         }
+    }
+}
+
+SliderBackend active_slider_backend = SliderBackend::Magic;
+static bool magics_found = false;
+
+const char* slider_backend_name(SliderBackend backend)
+{
+    switch (backend)
+    {
+    case SliderBackend::Magic: return "magic";
+    case SliderBackend::Pext:  return "pext";
+    }
+
+    return "unknown";
+}
+
+bool set_slider_backend(SliderBackend backend)
+{
+    if (backend == SliderBackend::Pext && !(HAS_PEXT && cpu_features().bmi2))
+    {
+        return false;
+    }
+
+    if (backend == SliderBackend::Magic && !magics_found)
+    {
+        find_slider_magics(rook_magics, RookDirections);
+        find_slider_magics(bishop_magics, BishopDirections);
+        magics_found = true;
+    }
+
+    active_slider_backend = backend;
+    fill_slider_tables(rook_magics, RookDirections);
+    fill_slider_tables(bishop_magics, BishopDirections);
+
+    return true;
+}
+
+void initialize_attack_tables()
+{
+    static bool initialized = false;
+    if (initialized)
+        return;
+
+    initialize_slider_masks(rook_magics, rook_attack_table, RookDirections);
+    initialize_slider_masks(bishop_magics, bishop_attack_table, BishopDirections);
+
+    // pext needs no magic search, so startup is also cheaper there
+    CpuFeatures features = cpu_features();
+    set_slider_backend(features.fast_pext ? SliderBackend::Pext : SliderBackend::Magic);
+
+    initialize_line_tables();
+
+    initialized = true;
+}
+
+Bitboard calculate_orthogonal_moves(Bitboard pieces, Bitboard blockers, Bitboard captures)
+{
+    Bitboard occupied = blockers | captures;
+    Bitboard moves = 0;
+
+    while (pieces)
+    {
+        moves |= rook_attacks(pop_lsb(&pieces), occupied);
+    }
+
+    return moves & ~blockers;
+}
+
+Bitboard calculate_diagonal_moves(Bitboard pieces, Bitboard blockers, Bitboard captures)
+{
+    Bitboard occupied = blockers | captures;
+    Bitboard moves = 0;
+
+    while (pieces)
+    {
+        moves |= bishop_attacks(pop_lsb(&pieces), occupied);
+    }
+
+    return moves & ~blockers;
+}
+
+// Shift by a direction, positive towards h8. Squares pushed over the side of the board come
+// back on the far file, so each direction is paired with the mask that removes them.
+template <int Amount, Bitboard FileMask>
+static inline Bitboard step(Bitboard b)
+{
+    if constexpr (Amount > 0)
+        return (b << Amount) & FileMask;
+    else
+        return (b >> -Amount) & FileMask;
+}
+
+// Kogge-stone occluded fill: the generator spreads through the empty squares in three doubling
+// steps, which covers the longest ray of seven squares. The propagator loses the file a step
+// wraps from, and a last step moves the ray onto the first blocker.
+template <int Amount, Bitboard FileMask>
+static inline Bitboard ray_fill(Bitboard generate, Bitboard empty)
+{
+    Bitboard propagate = empty & FileMask;
+
+    generate |= propagate & step<Amount, ~0ull>(generate);
+    propagate &= step<Amount, ~0ull>(propagate);
+    generate |= propagate & step<2 * Amount, ~0ull>(generate);
+    propagate &= step<2 * Amount, ~0ull>(propagate);
+    generate |= propagate & step<4 * Amount, ~0ull>(generate);
+
+    return step<Amount, FileMask>(generate);
+}
+
+Bitboard orthogonal_fill(Bitboard sliders, Bitboard empty)
+{
+    return ray_fill<8, ~0ull>(sliders, empty)
+         | ray_fill<-8, ~0ull>(sliders, empty)
+         | ray_fill<1, NOT_FILE_A>(sliders, empty)
+         | ray_fill<-1, NOT_FILE_H>(sliders, empty);
+}
+
+Bitboard diagonal_fill(Bitboard sliders, Bitboard empty)
+{
+    return ray_fill<9, NOT_FILE_A>(sliders, empty)
+         | ray_fill<7, NOT_FILE_H>(sliders, empty)
+         | ray_fill<-7, NOT_FILE_A>(sliders, empty)
+         | ray_fill<-9, NOT_FILE_H>(sliders, empty);
+}
+
+Bitboard knight_fill(Bitboard knights)
+{
+    return step<17, NOT_FILE_A>(knights) | step<15, NOT_FILE_H>(knights)
+         | step<10, NOT_FILE_AB>(knights) | step<6, NOT_FILE_GH>(knights)
+         | step<-6, NOT_FILE_AB>(knights) | step<-10, NOT_FILE_GH>(knights)
+         | step<-15, NOT_FILE_A>(knights) | step<-17, NOT_FILE_H>(knights);
+}
+
+Bitboard king_fill(Bitboard kings)
+{
+    Bitboard sides = step<1, NOT_FILE_A>(kings) | step<-1, NOT_FILE_H>(kings);
+    Bitboard row = kings | sides;
+    return sides | (row << 8) | (row >> 8);
+}
+
+Bitboard pawn_fill(Bitboard pawns, ChessColor color)
+{
+    return color == ChessColor::White
+        ? step<9, NOT_FILE_A>(pawns) | step<7, NOT_FILE_H>(pawns)
+        : step<-7, NOT_FILE_A>(pawns) | step<-9, NOT_FILE_H>(pawns);
+}
+
+Bitboard calculate_orthogonal_moves_setwise(Bitboard pieces, Bitboard blockers, Bitboard captures)
+{
+    return orthogonal_fill(pieces, ~(blockers | captures)) & ~blockers;
+}
+
+Bitboard calculate_diagonal_moves_setwise(Bitboard pieces, Bitboard blockers, Bitboard captures)
+{
+    return diagonal_fill(pieces, ~(blockers | captures)) & ~blockers;
+}
+
+// knights jump, so what stands in between does not matter and captures is not needed
+Bitboard calculate_knight_moves(Bitboard pieces, Bitboard blockers, Bitboard)
+{
+    Bitboard moves = 0;
+
+    while (pieces)
+    {
+        moves |= knight_attacks(pop_lsb(&pieces));
+    }
+
+    return moves & ~blockers;
+}
+
+#define SQUARE_A1 0
+#define SQUARE_C1 2
+#define SQUARE_D1 3
+#define SQUARE_E1 4
+#define SQUARE_F1 5
+#define SQUARE_G1 6
+#define SQUARE_H1 7
+#define SQUARE_A8 56
+#define SQUARE_C8 58
+#define SQUARE_D8 59
+#define SQUARE_E8 60
+#define SQUARE_F8 61
+#define SQUARE_G8 62
+#define SQUARE_H8 63
+
+// Everything that depends on the side to move, so the functions templated on it see constants
+// instead of branches. The runtime color is only looked at once, where they are dispatched.
+template <ChessColor Us>
+struct SideTraits {
+    static constexpr bool IsWhite = Us == ChessColor::White;
+    static constexpr ChessColor Them = opposite_color(Us);
+
+    static constexpr int Push = IsWhite ? 8 : -8;
+    static constexpr Bitboard DoublePushRow = IsWhite ? 0xffull << 16 : 0xffull << 40;
+    static constexpr Bitboard PromotionRow = IsWhite ? 0xffull << 56 : 0xffull;
+
+    static constexpr u8 KingSide = IsWhite ? WhiteKingSide : BlackKingSide;
+    static constexpr u8 QueenSide = IsWhite ? WhiteQueenSide : BlackQueenSide;
+    static constexpr SquareIndex KingHome = IsWhite ? SQUARE_E1 : SQUARE_E8;
+    static constexpr SquareIndex A = IsWhite ? SQUARE_A1 : SQUARE_A8;
+    static constexpr SquareIndex C = IsWhite ? SQUARE_C1 : SQUARE_C8;
+    static constexpr SquareIndex D = IsWhite ? SQUARE_D1 : SQUARE_D8;
+    static constexpr SquareIndex F = IsWhite ? SQUARE_F1 : SQUARE_F8;
+    static constexpr SquareIndex G = IsWhite ? SQUARE_G1 : SQUARE_G8;
+    static constexpr SquareIndex H = IsWhite ? SQUARE_H1 : SQUARE_H8;
+
+    static Bitboard& friendly(ChessState* state) { return IsWhite ? state->white : state->black; }
+    static Bitboard& opponent(ChessState* state) { return IsWhite ? state->black : state->white; }
+    static Bitboard friendly(const ChessState& state) { return IsWhite ? state.white : state.black; }
+    static Bitboard opponent(const ChessState& state) { return IsWhite ? state.black : state.white; }
+
+    static constexpr Bitboard push(Bitboard b) { return IsWhite ? b << 8 : b >> 8; }
+};
+
+template <ChessColor Us>
+static Bitboard pawn_moves(Bitboard pieces, Bitboard blockers, Bitboard captures)
+{
+    using Side = SideTraits<Us>;
+
+    Bitboard empty = ~(blockers | captures);
+
+    // pushes for all pawns at once, a double push needs the single push square to be empty too
+    Bitboard single = Side::push(pieces) & empty;
+    Bitboard moves = single | (Side::push(single & Side::DoublePushRow) & empty);
+
+    while (pieces)
+    {
+        moves |= pawn_attacks(Us, pop_lsb(&pieces)) & captures;
+    }
+
+    return moves;
+}
+
+Bitboard calculate_pawn_moves(Bitboard pieces, Bitboard blockers, Bitboard captures, ChessColor color)
+{
+    return color == ChessColor::White
+        ? pawn_moves<ChessColor::White>(pieces, blockers, captures)
+        : pawn_moves<ChessColor::Black>(pieces, blockers, captures);
+}
 
-        if (column != 8)
-            return false;
-        row -= 1;
-    }
+Bitboard attackers_to(const ChessState& state, SquareIndex square, Bitboard occupied)
+{
+    Bitboard orthogonal = state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen];
+    Bitboard diagonal = state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen];
+
+    return (pawn_attacks(ChessColor::White, square) & state.black & state.pieces[PieceType::Pawn])
+         | (pawn_attacks(ChessColor::Black, square) & state.white & state.pieces[PieceType::Pawn])
+         | (knight_attacks(square) & state.pieces[PieceType::Knight])
+         | (king_attacks(square) & state.pieces[PieceType::King])
+         | (rook_attacks(square, occupied) & orthogonal)
+         | (bishop_attacks(square, occupied) & diagonal);
+}
 
-    if (fen[cursor] != ' ')
-        return false;
-    ADVANCE();
+bool is_square_attacked(const ChessState& state, SquareIndex square, ChessColor by)
+{
+    Bitboard them = by == ChessColor::White ? state.white : state.black;
+
+    // an attacker of a piece stands on a square that piece would attack from the target, cheapest lookups first
+    if (pawn_attacks(opposite_color(by), square) & them & state.pieces[PieceType::Pawn])
+        return true;
+    if (knight_attacks(square) & them & state.pieces[PieceType::Knight])
+        return true;
+    if (king_attacks(square) & them & state.pieces[PieceType::King])
+        return true;
+
+    Bitboard occupied = state.white | state.black;
+    Bitboard queens = state.pieces[PieceType::Queen];
+    if (rook_attacks(square, occupied) & them & (state.pieces[PieceType::Rook] | queens))
+        return true;
+    return (bishop_attacks(square, occupied) & them & (state.pieces[PieceType::Bishop] | queens)) != 0;
+}
 
-    ChessColor side_to_move = ChessColor::White;
-    if (fen[cursor] == 'w')
-        side_to_move = ChessColor::White;
-    else if (fen[cursor] == 'b')
-        side_to_move = ChessColor::Black;
-    else
+bool in_check(const ChessState& state)
+{
+    ChessColor us = state.side_to_move;
+    Bitboard king = state.pieces[PieceType::King] & (us == ChessColor::White ? state.white : state.black);
+    if (!king)
         return false;
 
-    state->side_to_move = side_to_move;
+    // the king is rarely attacked, so the early exit of is_square_attacked buys nothing here and
+    // the branchless mask measures no slower in bench attacked
+    Bitboard them = us == ChessColor::White ? state.black : state.white;
+    return (attackers_to(state, SquareIndex(TRAILING_ZEROS(king)), state.white | state.black) & them) != 0;
+}
 
-    ADVANCE();
+// attack set of whatever stands on the square
+static Bitboard piece_attacks(const ChessState& state, SquareIndex square, Bitboard occupied)
+{
+    switch (state.piece_on(square))
+    {
+        case PieceType::Pawn:
+            return pawn_attacks(state.white & BIT(square) ? ChessColor::White : ChessColor::Black, square);
+        case PieceType::Knight: return knight_attacks(square);
+        case PieceType::Bishop: return bishop_attacks(square, occupied);
+        case PieceType::Rook:   return rook_attacks(square, occupied);
+        case PieceType::Queen:  return queen_attacks(square, occupied);
+        case PieceType::King:   return king_attacks(square);
+        default:                return 0;
+    }
+}
 
-    if (fen[cursor] != ' ')
-        return false;
-    ADVANCE();
+// the aggregates are a union over at most 32 pieces, cheaper to redo than to track per square
+static void sum_attack_maps(ChessPosition* position, const SquareMaps& maps)
+{
+    const ChessState& state = position->board;
 
-    bool wck = false;
-    bool wcq = false;
-    bool bck = false;
-    bool bcq = false;
-    {
-        int save = cursor;
-        if (fen[cursor] == 'K') { wck = true; ADVANCE(); }
-        if (fen[cursor] == 'Q') { wcq = true; ADVANCE(); }
-        if (fen[cursor] == 'k') { bck = true; ADVANCE(); }
-        if (fen[cursor] == 'q') { bcq = true; ADVANCE(); }
+    Bitboard white = state.white;
+    Bitboard black = state.black;
+    position->white_attacks = 0;
+    position->black_attacks = 0;
 
-        if (cursor == save)
-        {
-            if (fen[cursor] == '-')
-            {
-                ADVANCE();
-            }
-            else
-                return false;
-        }
-    }
-    state->wck = wck;
-    state->wcq = wcq;
-    state->bck = bck;
-    state->bcq = bcq;
+    while (white)
+        position->white_attacks |= maps.attacks[pop_lsb(&white)];
+    while (black)
+        position->black_attacks |= maps.attacks[pop_lsb(&black)];
+}
 
-    if (fen[cursor] != ' ')
-        return false;
-    ADVANCE();
+void compute_attack_maps(ChessPosition* position, SquareMaps* maps)
+{
+    const ChessState& state = position->board;
+    Bitboard occupied = state.white | state.black;
 
-    if (fen[cursor] == '-')
+    for (int square = 0; square < 64; square++)
     {
-        ADVANCE();
+        maps->attacks[square] = piece_attacks(state, square, occupied);
     }
-    else
-    {
-        // bounds check
-        if (cursor + 2 >= fen.size)
-            return false;
-
-        SquareIndex square = parse_square(fen[cursor + 1], fen[cursor]);
-        if (square == NullSquareIndex)
-        {
-            return false;
-        }
 
-        state->en_passant_square = square;
-        cursor += 2;
-    }
+    sum_attack_maps(position, *maps);
+}
 
-    if (fen[cursor] != ' ')
+void update_attack_maps(ChessPosition* position, SquareMaps* maps, Bitboard old_occupied, Bitboard touched)
+{
+    const ChessState& state = position->board;
+    Bitboard occupied = state.white | state.black;
+
+    Bitboard orthogonal = state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen];
+    Bitboard diagonal = state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen];
+
+    // A slider ray changes only where a square was emptied or filled, and the slider then saw
+    // that square before the change: as its first blocker or as an empty square on the ray.
+    // Looking back from the square with the old occupancy finds exactly those sliders.
+    Bitboard flipped = old_occupied ^ occupied;
+    Bitboard dirty = touched | flipped;
+    while (flipped)
     {
-        return false;
+        SquareIndex square = pop_lsb(&flipped);
+        dirty |= (rook_attacks(square, old_occupied) & orthogonal) | (bishop_attacks(square, old_occupied) & diagonal);
     }
-    cursor += 1;
 
-    String half_move_string = string_slice_to_character(fen, cursor, ' ');
-    bool half_move_success = false;
-    int half_move_counter = string_to_integer(half_move_string, &half_move_success);
-    cursor += half_move_string.size;
-    if (!half_move_success)
+    while (dirty)
     {
-        return false;
+        SquareIndex square = pop_lsb(&dirty);
+        maps->attacks[square] = piece_attacks(state, square, occupied);
     }
 
-    state->half_move = half_move_counter;
+    sum_attack_maps(position, *maps);
+}
 
-    if (fen[cursor] != ' ')
-    {
-        return false;
-    }
-    ADVANCE();
+void make_move(ChessPosition* position, SquareMaps* maps, ChessMove move, ChessUndo* undo)
+{
+    Bitboard old_occupied = position->board.white | position->board.black;
+    make_move(&position->board, move, undo);
+    update_attack_maps(position, maps, old_occupied, BIT(move.from()) | BIT(move.to()));
+}
+
+void unmake_move(ChessPosition* position, SquareMaps* maps, ChessMove move, const ChessUndo& undo)
+{
+    Bitboard old_occupied = position->board.white | position->board.black;
+    unmake_move(&position->board, move, undo);
+    update_attack_maps(position, maps, old_occupied, BIT(move.from()) | BIT(move.to()));
+}
 
-    String full_move_string = string_slice(fen, cursor, fen.size);
-    bool full_move_success = false;
-    int full_move_clock = string_to_integer(full_move_string, &full_move_success);
-    cursor += full_move_string.size;
-    if (!full_move_success)
+static ChessMove* add_moves(ChessMove* moves, SquareIndex from, Bitboard targets)
+{
+    while (targets)
     {
-        return false;
+        *moves++ = ChessMove(from, pop_lsb(&targets));
     }
 
-    state->move_clock = full_move_clock;
-
-    return true;
+    return moves;
 }
 
-bool ChessGame::make_move(SquareIndex from, SquareIndex to)
+static ChessMove* add_promotions(ChessMove* moves, SquareIndex from, SquareIndex to)
 {
-    Bitboard source = BIT(from);
-    Bitboard destination = BIT(to);
+    *moves++ = ChessMove(from, to, MoveKind::Promotion, PieceType::Queen);
+    *moves++ = ChessMove(from, to, MoveKind::Promotion, PieceType::Rook);
+    *moves++ = ChessMove(from, to, MoveKind::Promotion, PieceType::Bishop);
+    *moves++ = ChessMove(from, to, MoveKind::Promotion, PieceType::Knight);
+    return moves;
+}
 
-    Bitboard friendly = 0;
-    Bitboard opponent = 0;
+template <ChessColor Us, GenType Type>
+int generate_legal_moves(const ChessState& state, ChessMove* moves)
+{
+    using Side = SideTraits<Us>;
 
-    ASSERT(!(position.board.white & position.board.black));
+    constexpr bool Captures = Type != GenType::Quiets;
+    constexpr bool Quiets = Type != GenType::Captures;
 
-    bool is_white_move = position.board.white & source;
+    ChessMove* cursor = moves;
 
-    friendly = is_white_move ? position.board.white : position.board.black;
-    opponent = is_white_move ? position.board.black : position.board.white;
+    Bitboard friendly = Side::friendly(state);
+    Bitboard opponent = Side::opponent(state);
+    Bitboard occupied = friendly | opponent;
 
-    if (friendly & destination)
+    Bitboard king = state.pieces[PieceType::King] & friendly;
+    if (!king)
     {
-        return false;
+        return 0;
     }
 
-    bool is_capture = opponent & destination;
+    SquareIndex king_square = TRAILING_ZEROS(king);
+
+    Bitboard opponent_orthogonal = (state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen]) & opponent;
+    Bitboard opponent_diagonal = (state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen]) & opponent;
 
-    if (is_white_move)
+    Bitboard checkers = attackers_to(state, king_square, occupied) & opponent;
+
+    // destinations of the requested kind, before check and pins narrow them down
+    Bitboard wanted = (Captures ? opponent : 0) | (Quiets ? ~occupied : 0);
+
+    // king steps, the king is taken off the board so it can not hide from a slider behind itself
     {
-        if (position.board.side_to_move != ChessColor::White)
+        Bitboard occupied_without_king = occupied ^ king;
+        Bitboard targets = king_attacks(king_square) & wanted;
+        while (targets)
         {
-            return false;
+            SquareIndex to = pop_lsb(&targets);
+            if (!(attackers_to(state, to, occupied_without_king) & opponent))
+            {
+                *cursor++ = ChessMove(king_square, to);
+            }
         }
+    }
+
+    // in double check only the king can move
+    if (checkers & (checkers - 1))
+    {
+        return int(cursor - moves);
+    }
+
+    // destinations that resolve a single check, either capturing the checker or blocking its ray
+    Bitboard evasion_mask = ~0ull;
+    if (checkers)
+    {
+        evasion_mask = checkers | between_squares[king_square][TRAILING_ZEROS(checkers)];
+    }
 
-        if (!(position.white_moves & destination))
+    // a friendly piece alone between the king and an enemy slider may only move along that line
+    Bitboard pinned = 0;
+    {
+        Bitboard snipers = (rook_attacks(king_square, 0) & opponent_orthogonal)
+                         | (bishop_attacks(king_square, 0) & opponent_diagonal);
+        while (snipers)
         {
-            return false;
+            Bitboard blockers = between_squares[king_square][pop_lsb(&snipers)] & occupied;
+            if (blockers && !(blockers & (blockers - 1)) && (blockers & friendly))
+            {
+                pinned |= blockers;
+            }
         }
+    }
+
+    Bitboard targets = wanted & evasion_mask;
 
-        position.board.white &= ~source;
-        position.board.white |= destination;
+    // a pinned knight can never stay on the pin line
+    Bitboard knights = state.pieces[PieceType::Knight] & friendly & ~pinned;
+    while (knights)
+    {
+        SquareIndex from = pop_lsb(&knights);
+        cursor = add_moves(cursor, from, knight_attacks(from) & targets);
+    }
 
-        if (is_capture)
+    Bitboard diagonal = (state.pieces[PieceType::Bishop] | state.pieces[PieceType::Queen]) & friendly;
+    while (diagonal)
+    {
+        SquareIndex from = pop_lsb(&diagonal);
+        Bitboard attacks = bishop_attacks(from, occupied) & targets;
+        if (pinned & BIT(from))
         {
-            position.board.black &= ~destination;
+            attacks &= line_squares[king_square][from];
         }
+        cursor = add_moves(cursor, from, attacks);
     }
-    else
+
+    Bitboard orthogonal = (state.pieces[PieceType::Rook] | state.pieces[PieceType::Queen]) & friendly;
+    while (orthogonal)
     {
-        if (position.board.side_to_move != ChessColor::Black)
+        SquareIndex from = pop_lsb(&orthogonal);
+        Bitboard attacks = rook_attacks(from, occupied) & targets;
+        if (pinned & BIT(from))
         {
-            return false;
+            attacks &= line_squares[king_square][from];
         }
+        cursor = add_moves(cursor, from, attacks);
+    }
+
+    constexpr int push = Side::Push;
+
+    Bitboard pawns = state.pieces[PieceType::Pawn] & friendly;
+    while (pawns)
+    {
+        SquareIndex from = pop_lsb(&pawns);
+        Bitboard pawn_targets = 0;
 
-        if (!(position.black_moves & destination))
+        // shifting the bitboard rather than the index, two rows ahead can be off the board
+        Bitboard single = Side::push(BIT(from));
+        if (!(single & occupied))
         {
-            return false;
+            pawn_targets |= single;
+
+            Bitboard twice = Side::push(single);
+            if ((single & Side::DoublePushRow) && !(twice & occupied))
+            {
+                pawn_targets |= twice;
+            }
         }
 
-        position.board.black &= ~source;
-        position.board.black |= destination;
+        pawn_targets |= pawn_attacks(Us, from) & opponent;
+        pawn_targets &= evasion_mask;
 
-        if (is_capture)
+        // every promotion counts as a capture, it changes the material just as much
+        if (!Quiets)
+            pawn_targets &= opponent | Side::PromotionRow;
+        if (!Captures)
+            pawn_targets &= ~(opponent | Side::PromotionRow);
+
+        if (pinned & BIT(from))
         {
-            position.board.white &= ~destination;
+            pawn_targets &= line_squares[king_square][from];
         }
-    }
 
-    PieceType source_piece = position.board.squares[from];
-    PieceType destination_piece = position.board.squares[to];
-    position.board.pieces[source_piece] &= ~source;
-    position.board.pieces[destination_piece] &= ~destination;
-    position.board.pieces[source_piece] |= destination;
+        while (pawn_targets)
+        {
+            SquareIndex to = pop_lsb(&pawn_targets);
+            if (BIT(to) & Side::PromotionRow)
+            {
+                cursor = add_promotions(cursor, from, to);
+            }
+            else
+            {
+                *cursor++ = ChessMove(from, to);
+            }
+        }
 
-    position.board.squares[from] = PieceType::Sentinel;
-    position.board.squares[to] = source_piece;
+        SquareIndex en_passant = state.en_passant_square;
+        if (Captures && en_passant != NullSquareIndex && (pawn_attacks(Us, from) & BIT(en_passant)))
+        {
+            SquareIndex captured = en_passant - push;
 
-    ChessMove move = {};
-    move.from = from;
-    move.to = to;
-    move.capture = is_capture;
+            // the captured pawn may be the checker itself
+            if (evasion_mask & (BIT(en_passant) | BIT(captured)))
+            {
+                // two pawns leave the board at once, so the pin masks do not cover it. Look again from the
+                // king through the final occupancy, which also catches the horizontal pin along the row.
+                Bitboard after = (occupied ^ BIT(from) ^ BIT(captured)) | BIT(en_passant);
+                if (!(rook_attacks(king_square, after) & opponent_orthogonal) &&
+                    !(bishop_attacks(king_square, after) & opponent_diagonal))
+                {
+                    *cursor++ = ChessMove(from, en_passant, MoveKind::EnPassant);
+                }
+            }
+        }
+    }
 
-    moves.add(move);
+    if (Quiets && !checkers)
+    {
+        constexpr SquareIndex home = Side::KingHome;
+        bool king_side = state.castling & Side::KingSide;
+        bool queen_side = state.castling & Side::QueenSide;
+        Bitboard rooks = state.pieces[PieceType::Rook] & friendly;
 
-    position.board.side_to_move = is_white_move ? ChessColor::Black : ChessColor::White;
+        auto is_attacked = [&](SquareIndex square) {
+            return (attackers_to(state, square, occupied) & opponent) != 0;
+        };
 
-    return true;
-}
+        if (king_square == home)
+        {
+            constexpr SquareIndex f = Side::F, g = Side::G, h = Side::H;
+            if (king_side && (rooks & BIT(h)) && !(occupied & (BIT(f) | BIT(g))) &&
+                !is_attacked(f) && !is_attacked(g))
+            {
+                *cursor++ = ChessMove(home, g, MoveKind::Castling);
+            }
 
-bool ChessGame::undo_move()
-{
-    if (!moves.size()) return false;
+            constexpr SquareIndex d = Side::D, c = Side::C, a = Side::A;
+            // the b square has to be empty but may be attacked
+            if (queen_side && (rooks & BIT(a)) && !(occupied & between_squares[home][a]) &&
+                !is_attacked(d) && !is_attacked(c))
+            {
+                *cursor++ = ChessMove(home, c, MoveKind::Castling);
+            }
+        }
+    }
 
-    moves.pop();
-    return true;
+    return int(cursor - moves);
 }
 
-bool ChessGame::set_position(ChessState state)
+int generate_legal_moves(const ChessState& state, ChessMove* moves)
 {
-    position = {};
-    position.board = state;
-
-    calculate_moves();
-
-    return true;
+    return state.side_to_move == ChessColor::White
+        ? generate_legal_moves<ChessColor::White>(state, moves)
+        : generate_legal_moves<ChessColor::Black>(state, moves);
 }
 
-void ChessGame::calculate_moves()
+void generate_legal_moves(const ChessState& state, MoveList* list)
 {
-    Bitboard white_moves = 0;
-    Bitboard black_moves = 0;
+    list->set_size(generate_legal_moves(state, list->data()));
+}
 
-    position.white_moves = white_moves;
-    position.black_moves = black_moves;
-    calculate_king_moves();
+int generate_captures(const ChessState& state, ChessMove* moves)
+{
+    return state.side_to_move == ChessColor::White
+        ? generate_legal_moves<ChessColor::White, GenType::Captures>(state, moves)
+        : generate_legal_moves<ChessColor::Black, GenType::Captures>(state, moves);
 }
 
-void ChessGame::calculate_king_moves()
+int generate_quiets(const ChessState& state, ChessMove* moves)
 {
-    // @todo
+    return state.side_to_move == ChessColor::White
+        ? generate_legal_moves<ChessColor::White, GenType::Quiets>(state, moves)
+        : generate_legal_moves<ChessColor::Black, GenType::Quiets>(state, moves);
 }
 
-void ChessState::put_piece(PieceType type, ChessColor color, SquareIndex index)
+template <ChessColor Us>
+static bool is_legal_move(const ChessState& state, ChessMove move)
 {
-    Bitboard square = BIT(index);
+    using Side = SideTraits<Us>;
 
-    if (color == ChessColor::White)
+    Bitboard friendly = Side::friendly(state);
+    Bitboard opponent = Side::opponent(state);
+    Bitboard occupied = friendly | opponent;
+
+    SquareIndex from = move.from();
+    SquareIndex to = move.to();
+    PieceType piece = state.piece_on(from);
+
+    if (move.is_null() || !(friendly & BIT(from)) || (friendly & BIT(to)))
     {
-        white |= square;
+        return false;
     }
-    else if (color == ChessColor::Black)
+
+    // rare enough that the full generator is the simplest honest answer
+    if (move.kind() == MoveKind::Castling || move.kind() == MoveKind::EnPassant)
     {
-        black |= square;
+        ChessMove moves[MAX_MOVES];
+        int count = generate_legal_moves<Us>(state, moves);
+        for (int i = 0; i < count; i++)
+        {
+            if (moves[i] == move)
+                return true;
+        }
+        return false;
     }
 
-
-    if (type == PieceType::King) {
-        Bitboard white_king = white & pieces[PieceType::King];
-        Bitboard black_king = black & pieces[PieceType::King];
-        if ((color == ChessColor::White &&
-             white_king != 0 &&
-             white_king != square) ||
-            (color == ChessColor::Black &&
-             black_king != 0 &&
-             black_king != square)
-            )
+    Bitboard reach = 0;
+    switch (piece)
+    {
+        case PieceType::Pawn:
         {
-            log_warning("Trying to place more than one king on the board");
-            return;
-        }
+            if ((move.kind() == MoveKind::Promotion) != ((BIT(to) & Side::PromotionRow) != 0))
+                return false;
+
+            Bitboard single = Side::push(BIT(from)) & ~occupied;
+            Bitboard twice = Side::push(single & Side::DoublePushRow) & ~occupied;
+            reach = single | twice | (pawn_attacks(Us, from) & opponent);
+        } break;
+        case PieceType::Knight: reach = knight_attacks(from); break;
+        case PieceType::Bishop: reach = bishop_attacks(from, occupied); break;
+        case PieceType::Rook:   reach = rook_attacks(from, occupied); break;
+        case PieceType::Queen:  reach = queen_attacks(from, occupied); break;
+        case PieceType::King:   reach = king_attacks(from); break;
+        default: return false;
     }
 
-    pieces[type] |= square;
+    if (!(reach & BIT(to)) || (piece != PieceType::Pawn && move.kind() != MoveKind::Normal))
+    {
+        return false;
+    }
+
+    // the move is possible, now the own king must not be attacked once it is made
+    Bitboard after = (occupied ^ BIT(from)) | BIT(to);
+    SquareIndex king_square = piece == PieceType::King ? to : TRAILING_ZEROS(state.pieces[PieceType::King] & friendly);
+
+    return !(attackers_to(state, king_square, after) & opponent & ~BIT(to));
 }
 
-void ChessState::put_piece(PieceType type, ChessColor color, BoardPosition position)
+bool is_legal_move(const ChessState& state, ChessMove move)
 {
-    put_piece(type, color, board_position_to_bitboard(position));
+    return state.side_to_move == ChessColor::White
+        ? is_legal_move<ChessColor::White>(state, move)
+        : is_legal_move<ChessColor::Black>(state, move);
 }
 
-void ChessState::clear_square(SquareIndex index)
+ChessMove find_move(const MoveList& moves, SquareIndex from, SquareIndex to, PieceType promotion)
 {
-    Bitboard c = ~BIT(index);
-    white &= c;
-    black &= c;
-    for (int i = 0; i < PieceType::Count; i++)
+    for (ChessMove move : moves)
     {
-        pieces[i] &= c;
+        if (move.from() != from || move.to() != to)
+        {
+            continue;
+        }
+
+        if (move.kind() == MoveKind::Promotion && move.promotion() != promotion)
+        {
+            continue;
+        }
+
+        return move;
     }
+
+    return null_move();
 }
 
-ChessPosition calculate_position(ChessState state)
+Bitboard move_targets(const MoveList& moves, SquareIndex from)
 {
-    ChessPosition position;
+    Bitboard targets = 0;
+    for (ChessMove move : moves)
+    {
+        if (move.from() == from)
+        {
+            targets |= BIT(move.to());
+        }
+    }
 
-    return position;
+    return targets;
 }
 
-Bitboard calculate_direction_moves(Bitboard pieces, Bitboard blockers, Bitboard captures, Array<int> offsets, int depth)
+// castling rights that survive a move touching the square, anded for both from and to
+static const u8 CastlingKeep[64] = {
+    u8(~WhiteQueenSide), 0xff, 0xff, 0xff, u8(~(WhiteKingSide | WhiteQueenSide)), 0xff, 0xff, u8(~WhiteKingSide),
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    u8(~BlackQueenSide), 0xff, 0xff, 0xff, u8(~(BlackKingSide | BlackQueenSide)), 0xff, 0xff, u8(~BlackKingSide),
+};
+
+// rook squares of a castling move, indexed by the square the king lands on
+static void castling_rook_squares(SquareIndex king_from, SquareIndex king_to, SquareIndex* rook_from, SquareIndex* rook_to)
 {
-    Bitboard moves = 0;
+    bool king_side = king_to > king_from;
+    *rook_from = king_side ? king_from + 3 : king_from - 4;
+    *rook_to = king_side ? king_from + 1 : king_from - 1;
+}
 
-    while (pieces)
-    {
-        SquareIndex index = pop_lsb(&pieces);
+template <ChessColor Us>
+void make_move(ChessState* state, ChessMove move, ChessUndo* undo)
+{
+    using Side = SideTraits<Us>;
 
-        Bitboard square = BIT(index);
-        BoardPosition position = index_to_board_position(index);
+    Bitboard& friendly = Side::friendly(state);
+    Bitboard& opponent = Side::opponent(state);
 
-        for (int i = 0; i < offsets.size; i++)
-        {
-            int step = offsets[i];
-            int square_index = index + step;
-            int row    = square_index / 8;
-            int column = square_index % 8;
+    SquareIndex from = move.from();
+    SquareIndex to = move.to();
+    PieceType piece = state->piece_on(from);
+    PieceType captured = state->piece_on(to);
 
-            int iter = 0;
+    undo->captured = captured;
+    undo->castling = state->castling;
+    undo->en_passant_square = state->en_passant_square;
+    undo->half_move = state->half_move;
+    undo->hash = state->hash;
 
-            while ((row < 8 && row >= 0 && column < 8 && column >= 0) && iter < depth)
-            {
-                Bitboard m = BIT(square_index);
-                if (m & blockers)
-                {
-                    break;
-                }
-                if (m & captures)
-                {
-                    moves |= m;
-                    break;
-                }
+    const auto& our_keys = Zobrist.pieces[int(Us)];
+    const auto& their_keys = Zobrist.pieces[int(Side::Them)];
+    u64 hash = state->hash;
+
+    state->half_move += 1;
+
+    if (move.kind() == MoveKind::EnPassant)
+    {
+        SquareIndex captured_square = to - Side::Push;
+        opponent &= ~BIT(captured_square);
+        state->pieces[PieceType::Pawn] &= ~BIT(captured_square);
+        state->set_piece_on(captured_square, PieceType::Sentinel);
+        undo->captured = PieceType::Pawn;
+        hash ^= their_keys[PieceType::Pawn][captured_square];
+    }
+    else if (captured != PieceType::Sentinel)
+    {
+        opponent &= ~BIT(to);
+        state->pieces[captured] &= ~BIT(to);
+        state->half_move = 0;
+        hash ^= their_keys[captured][to];
+    }
+
+    Bitboard from_to = BIT(from) | BIT(to);
+    friendly ^= from_to;
+    state->pieces[piece] ^= from_to;
+    state->set_piece_on(from, PieceType::Sentinel);
+    state->set_piece_on(to, piece);
+    hash ^= our_keys[piece][from] ^ our_keys[piece][to];
 
-                moves |= m;
+    if (move.kind() == MoveKind::Promotion)
+    {
+        state->pieces[PieceType::Pawn] &= ~BIT(to);
+        state->pieces[move.promotion()] |= BIT(to);
+        state->set_piece_on(to, move.promotion());
+        hash ^= our_keys[PieceType::Pawn][to] ^ our_keys[move.promotion()][to];
+    }
+    else if (move.kind() == MoveKind::Castling)
+    {
+        SquareIndex rook_from, rook_to;
+        castling_rook_squares(from, to, &rook_from, &rook_to);
+        Bitboard rook_from_to = BIT(rook_from) | BIT(rook_to);
+
+        friendly ^= rook_from_to;
+        state->pieces[PieceType::Rook] ^= rook_from_to;
+        state->set_piece_on(rook_from, PieceType::Sentinel);
+        state->set_piece_on(rook_to, PieceType::Rook);
+        hash ^= our_keys[PieceType::Rook][rook_from] ^ our_keys[PieceType::Rook][rook_to];
+    }
 
-                square_index += step;
-                row = square_index / 8;
-                column = square_index % 8;
+    if (state->en_passant_square != NullSquareIndex)
+    {
+        hash ^= Zobrist.en_passant_file[state->en_passant_square % 8];
+        state->en_passant_square = NullSquareIndex;
+    }
 
-                iter += 1;
+    if (piece == PieceType::Pawn)
+    {
+        state->half_move = 0;
+        if (to - from == 16 || from - to == 16)
+        {
+            SquareIndex en_passant = (from + to) / 2;
+            if (can_capture_en_passant(*state, en_passant, Side::Them))
+            {
+                state->en_passant_square = en_passant;
+                hash ^= Zobrist.en_passant_file[en_passant % 8];
             }
         }
     }
 
-    return moves;
-}
+    hash ^= Zobrist.castling[state->castling];
+    state->castling &= CastlingKeep[from] & CastlingKeep[to];
+    hash ^= Zobrist.castling[state->castling];
 
-Bitboard calculate_orthogonal_moves(Bitboard pieces, Bitboard blockers, Bitboard captures)
-{
-    int offsets[4] = { -8, -1, 1, 8 };
-    return calculate_direction_moves(pieces, blockers, captures, make_array(offsets), 8);
-}
+    if (!Side::IsWhite)
+    {
+        state->move_clock += 1;
+    }
 
-Bitboard calculate_diagonal_moves(Bitboard pieces, Bitboard blockers, Bitboard captures)
-{
-    int offsets[4] = { -9, -7, 7, 9 };
-    return calculate_direction_moves(pieces, blockers, captures, make_array(offsets), 8);
-}
+    state->side_to_move = Side::Them;
+    state->hash = hash ^ Zobrist.side;
 
-Bitboard calculate_knight_moves(Bitboard pieces, Bitboard blockers, Bitboard captures)
-{
-    int offsets[8] = { -17, -15, -10, -6, 6, 10, 15, 17 };
-    return calculate_direction_moves(pieces, blockers, captures, make_array(offsets), 1);
+#if CHESS_DEBUG_HASH
+    ASSERT(state->hash == compute_hash(*state));
+#endif
 }
 
-Bitboard calculate_pawn_moves(SquareIndex index, Bitboard blockers, Bitboard captures, bool is_white)
+// Us is the side that played the move
+template <ChessColor Us>
+void unmake_move(ChessState* state, ChessMove move, const ChessUndo& undo)
 {
-    Bitboard moves = 0;
+    using Side = SideTraits<Us>;
 
-    Bitboard square = BIT(index);
-    BoardPosition position = index_to_board_position(index);
+    state->side_to_move = Us;
 
-    if (is_white && position.row == 7)
+    Bitboard& friendly = Side::friendly(state);
+    Bitboard& opponent = Side::opponent(state);
+
+    SquareIndex from = move.from();
+    SquareIndex to = move.to();
+    PieceType piece = state->piece_on(to);
+
+    if (move.kind() == MoveKind::Promotion)
     {
-        return 0;
+        state->pieces[piece] &= ~BIT(to);
+        state->pieces[PieceType::Pawn] |= BIT(to);
+        piece = PieceType::Pawn;
     }
-    if (!(is_white) && position.row == 0)
+    else if (move.kind() == MoveKind::Castling)
     {
-        return 0;
+        SquareIndex rook_from, rook_to;
+        castling_rook_squares(from, to, &rook_from, &rook_to);
+        Bitboard rook_from_to = BIT(rook_from) | BIT(rook_to);
+
+        friendly ^= rook_from_to;
+        state->pieces[PieceType::Rook] ^= rook_from_to;
+        state->set_piece_on(rook_to, PieceType::Sentinel);
+        state->set_piece_on(rook_from, PieceType::Rook);
     }
 
-    int dir = is_white ? 1 : -1;
-    Bitboard forward = BIT(index + 8 * dir);
-    Bitboard left = BIT(index + 7 * dir);
-    Bitboard right = BIT(index + 9 * dir);
+    Bitboard from_to = BIT(from) | BIT(to);
+    friendly ^= from_to;
+    state->pieces[piece] ^= from_to;
+    state->set_piece_on(from, piece);
+    state->set_piece_on(to, PieceType::Sentinel);
 
-    if (!(blockers & forward))
+    if (move.kind() == MoveKind::EnPassant)
     {
-        moves |= forward;
+        SquareIndex captured_square = to - Side::Push;
+        opponent |= BIT(captured_square);
+        state->pieces[PieceType::Pawn] |= BIT(captured_square);
+        state->set_piece_on(captured_square, PieceType::Pawn);
     }
-    if (left & blockers)
+    else if (undo.captured != PieceType::Sentinel)
     {
-        moves |= left;
+        opponent |= BIT(to);
+        state->pieces[undo.captured] |= BIT(to);
+        state->set_piece_on(to, undo.captured);
     }
-    if (right & blockers)
+
+    state->castling = undo.castling;
+    state->en_passant_square = undo.en_passant_square;
+    state->half_move = undo.half_move;
+    state->hash = undo.hash;
+
+    if (!Side::IsWhite)
     {
-        moves |= right;
+        state->move_clock -= 1;
     }
 
-    return moves;
+#if CHESS_DEBUG_HASH
+    ASSERT(state->hash == compute_hash(*state));
+#endif
+}
+
+template int generate_legal_moves<ChessColor::White, GenType::All>(const ChessState& state, ChessMove* moves);
+template int generate_legal_moves<ChessColor::Black, GenType::All>(const ChessState& state, ChessMove* moves);
+template int generate_legal_moves<ChessColor::White, GenType::Captures>(const ChessState& state, ChessMove* moves);
+template int generate_legal_moves<ChessColor::Black, GenType::Captures>(const ChessState& state, ChessMove* moves);
+template int generate_legal_moves<ChessColor::White, GenType::Quiets>(const ChessState& state, ChessMove* moves);
+template int generate_legal_moves<ChessColor::Black, GenType::Quiets>(const ChessState& state, ChessMove* moves);
+template void make_move<ChessColor::White>(ChessState* state, ChessMove move, ChessUndo* undo);
+template void make_move<ChessColor::Black>(ChessState* state, ChessMove move, ChessUndo* undo);
+template void unmake_move<ChessColor::White>(ChessState* state, ChessMove move, const ChessUndo& undo);
+template void unmake_move<ChessColor::Black>(ChessState* state, ChessMove move, const ChessUndo& undo);
+
+void make_move(ChessState* state, ChessMove move, ChessUndo* undo)
+{
+    if (state->side_to_move == ChessColor::White)
+        make_move<ChessColor::White>(state, move, undo);
+    else
+        make_move<ChessColor::Black>(state, move, undo);
+}
+
+void unmake_move(ChessState* state, ChessMove move, const ChessUndo& undo)
+{
+    if (state->side_to_move == ChessColor::Black)
+        unmake_move<ChessColor::White>(state, move, undo);
+    else
+        unmake_move<ChessColor::Black>(state, move, undo);
 }
 
 Bitboard bitboard_move(Bitboard b, Bitboard source, Bitboard destination)
@@ -517,7 +1746,7 @@ bool operator!=(BoardPosition pos0, BoardPosition pos1) {
     return pos0.row != pos1.row || pos1.column != pos1.column;
 }
 
-void print_board_state(ChessState state)
+void print_board_state(const ChessState& state)
 {
     printf("     a  b  c  d  e  f  g  h \n");
 
@@ -561,7 +1790,9 @@ void print_board_state(ChessState state)
     }
 
     printf("\n");
-    printf(" WKS: %d, WQS: %d, BKS: %d, BQS: %d \n", state.wck, state.wcq, state.bck, state.bcq);
+    printf(" WKS: %d, WQS: %d, BKS: %d, BQS: %d \n",
+           (state.castling & WhiteKingSide) != 0, (state.castling & WhiteQueenSide) != 0,
+           (state.castling & BlackKingSide) != 0, (state.castling & BlackQueenSide) != 0);
     printf(" En passant: %s\n", square_identifier_string(state.en_passant_square));
 }
 
@@ -601,15 +1832,35 @@ const char* square_identifier_string(SquareIndex index)
     if (index < 0 || index >= 64) return "!!";  // respect two characters
 
     const char* square_names[] = {
-        "a1", "a2", "a3", "a4", "a5", "a6", "a7", "a8",
-        "b1", "b2", "b3", "b4", "b5", "b6", "b7", "b8",
-        "c1", "c2", "c3", "c4", "c5", "c6", "c7", "c8",
-        "d1", "d2", "d3", "d4", "d5", "d6", "d7", "d8",
-        "e1", "e2", "e3", "e4", "e5", "e6", "e7", "e8",
-        "f1", "f2", "f3", "f4", "f5", "f6", "f7", "f8",
-        "g1", "g2", "g3", "g4", "g5", "g6", "g7", "g8",
-        "h1", "h2", "h3", "h4", "h5", "h6", "h7", "h8",
+        "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1",
+        "a2", "b2", "c2", "d2", "e2", "f2", "g2", "h2",
+        "a3", "b3", "c3", "d3", "e3", "f3", "g3", "h3",
+        "a4", "b4", "c4", "d4", "e4", "f4", "g4", "h4",
+        "a5", "b5", "c5", "d5", "e5", "f5", "g5", "h5",
+        "a6", "b6", "c6", "d6", "e6", "f6", "g6", "h6",
+        "a7", "b7", "c7", "d7", "e7", "f7", "g7", "h7",
+        "a8", "b8", "c8", "d8", "e8", "f8", "g8", "h8",
     };
 
     return square_names[index];
 }
+
+void move_to_string(ChessMove move, char buffer[6])
+{
+    const char* from = square_identifier_string(move.from());
+    const char* to = square_identifier_string(move.to());
+
+    int cursor = 0;
+    buffer[cursor++] = from[0];
+    buffer[cursor++] = from[1];
+    buffer[cursor++] = to[0];
+    buffer[cursor++] = to[1];
+
+    if (move.kind() == MoveKind::Promotion)
+    {
+        const char promotion_characters[] = { 'k', 'q', 'r', 'b', 'n', 'p' };
+        buffer[cursor++] = promotion_characters[move.promotion()];
+    }
+
+    buffer[cursor] = '\0';
+}
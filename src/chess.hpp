@@ -17,11 +17,16 @@ enum PieceType : u8 {
     Sentinel = 7,
 };
 
-enum class ChessColor {
+enum class ChessColor : u8 {
     White,
     Black,
 };
 
+constexpr ChessColor opposite_color(ChessColor color)
+{
+    return color == ChessColor::White ? ChessColor::Black : ChessColor::White;
+}
+
 #define PIECE_COLOR_BIT BIT(3)
 #define PIECE_TYPE_MASK 0b111
 
@@ -52,66 +57,341 @@ Bitboard board_position_to_bitboard(BoardPosition pos);
 BoardPosition index_to_board_position(SquareIndex index);
 SquareIndex board_position_to_index(BoardPosition pos);
 
-struct ChessState {
-    PieceType squares[64] = {};
+enum CastlingRight : u8 {
+    WhiteKingSide  = 1,
+    WhiteQueenSide = 2,
+    BlackKingSide  = 4,
+    BlackQueenSide = 8,
+};
 
+// Everything make_move touches and nothing else, in two cache lines: the bitboards fill the
+// first, the mailbox, key, rights and clocks the second.
+struct alignas(64) ChessState {
     Bitboard white = {};
     Bitboard black = {};
     Bitboard pieces[PieceType::Count] = {};
 
-    bool wck = false;
-    bool wcq = false;
-    bool bck = false;
-    bool bcq = false;
+    // two squares a byte, the even square in the low nibble, PieceType::Sentinel when empty
+    u8 mailbox[32];
+
+    u64 hash = 0;  // zobrist key, kept up to date by make_move and unmake_move
+
+    u16 half_move = 0;
+    u16 move_clock = 0;
+    u8 castling = 0;  // CastlingRight flags
 
+    // only set when a pawn of the side to move can capture there, so equal positions hash the same
     SquareIndex en_passant_square = NullSquareIndex;
-    u32 half_move = 0;
-    u32 move_clock = 0;
     ChessColor side_to_move = ChessColor::White;
 
+    ChessState()
+    {
+        for (int i = 0; i < 32; i++)
+        {
+            mailbox[i] = PieceType::Sentinel | (PieceType::Sentinel << 4);
+        }
+    }
+
+    PieceType piece_on(SquareIndex square) const
+    {
+        return PieceType((mailbox[square >> 1] >> ((square & 1) * 4)) & 0xf);
+    }
+
+    void set_piece_on(SquareIndex square, PieceType type)
+    {
+        int shift = (square & 1) * 4;
+        mailbox[square >> 1] = u8((mailbox[square >> 1] & ~(0xf << shift)) | (type << shift));
+    }
+
     void put_piece(PieceType type, ChessColor color, SquareIndex index);
     void put_piece(PieceType type, ChessColor color, BoardPosition position);
 
     void clear_square(SquareIndex index);
 };
 
-void print_board_state(ChessState state);
+static_assert(sizeof(ChessState) == 128, "ChessState is meant to fill exactly two cache lines");
+
+void print_board_state(const ChessState& state);
 
+// Checks the incremental zobrist key against a full recompute after every make and unmake.
+// Slow, for debugging move code only.
+#ifndef CHESS_DEBUG_HASH
+#define CHESS_DEBUG_HASH 0
+#endif
+
+// zobrist key of the position from scratch: pieces, side to move, castling rights and en passant file
+u64 compute_hash(const ChessState& state);
+
+// The board with what can be read off it. white_attacks / black_attacks are the squares each
+// side attacks, white_moves / black_moves the legal destinations of the side to move.
 struct ChessPosition {
     ChessState board = {};
     Bitboard white_moves = 0;
     Bitboard black_moves = 0;
-    Bitboard moves[64];
-    Bitboard attacks[64];
+    Bitboard white_attacks = 0;
+    Bitboard black_attacks = 0;
+};
+
+// The per square data, a kilobyte that only the GUI and evaluation read, kept out of
+// ChessPosition so the position stays small. attacks[square] is the attack set of the piece on
+// the square (nothing for an empty one), moves[square] its legal destinations, filled by
+// ChessGame::calculate_moves.
+struct SquareMaps {
+    Bitboard moves[64] = {};
+    Bitboard attacks[64] = {};
 };
 
+enum class MoveKind : u8 {
+    Normal,
+    Promotion,
+    EnPassant,
+    Castling,  // from and to are the king squares
+};
+
+// Packed into 16 bits so move lists stay small
+//   bits  0-5   from square
+//   bits  6-11  to square
+//   bits 12-13  promotion piece, knight to queen
+//   bits 14-15  MoveKind
 struct ChessMove {
-    SquareIndex from;
-    SquareIndex to;
-    bool capture;
-    bool check;
+    u16 data;
+
+    // left uninitialized so move lists cost nothing to create
+    ChessMove() = default;
+    ChessMove(SquareIndex from, SquareIndex to, MoveKind kind = MoveKind::Normal, PieceType promotion = PieceType::Queen)
+        : data(u16(from | (to << 6) | ((promotion - PieceType::Queen) << 12) | (u16(kind) << 14)))
+    {}
+
+    SquareIndex from() const { return data & 0x3f; }
+    SquareIndex to() const { return (data >> 6) & 0x3f; }
+    MoveKind kind() const { return MoveKind(data >> 14); }
+    // only meaningful for MoveKind::Promotion
+    PieceType promotion() const { return PieceType(((data >> 12) & 0x3) + PieceType::Queen); }
+
+    bool is_null() const { return data == 0; }
+    bool operator==(ChessMove other) const { return data == other.data; }
+    bool operator!=(ChessMove other) const { return data != other.data; }
+};
+
+static_assert(sizeof(ChessMove) == 2, "moves are packed into 16 bits");
+
+// a1 to a1 is never a real move
+static inline ChessMove null_move()
+{
+    ChessMove move;
+    move.data = 0;
+    return move;
+}
+
+// no position has more legal moves than this
+#define MAX_MOVES 256
+// longest game the history keeps
+#define MAX_GAME_PLY 2048
+// deepest line a search plays on top of the game
+#define MAX_SEARCH_PLY 128
+
+using MoveList = FixedArray<ChessMove, MAX_MOVES>;
+
+// Writes every legal move of the side to move into the buffer, which must hold MAX_MOVES,
+// and returns how many were written. Checkers, pins and the check evasion mask are computed
+// once up front so every written move is legal without trying it on the board.
+int generate_legal_moves(const ChessState& state, ChessMove* moves);
+void generate_legal_moves(const ChessState& state, MoveList* list);
+
+// Partial generation for the move picker. Captures are every capture, en passant and every
+// promotion, quiets are the rest including castling, together they are exactly the legal moves.
+enum class GenType : u8 {
+    All,
+    Captures,
+    Quiets,
 };
 
+int generate_captures(const ChessState& state, ChessMove* moves);
+int generate_quiets(const ChessState& state, ChessMove* moves);
+
+// whether a move from somewhere else, like the hash table or a killer slot, is legal here
+bool is_legal_move(const ChessState& state, ChessMove move);
+
+// What a move destroys and unmake_move can not work out from the move itself
+struct ChessUndo {
+    PieceType captured = PieceType::Sentinel;
+    u8 castling = 0;
+    SquareIndex en_passant_square = NullSquareIndex;
+    u16 half_move = 0;
+    u64 hash = 0;
+};
+
+// Plays a legal move on the state, including the castling rook, en passant capture,
+// promotion, castling rights, en passant square and the clocks. The undo record is all
+// unmake_move needs to take it back, so nobody has to keep copies of the state around.
+void make_move(ChessState* state, ChessMove move, ChessUndo* undo);
+void unmake_move(ChessState* state, ChessMove move, const ChessUndo& undo);
+
+// The same functions with the side to move known at compile time, for loops like perft and
+// search that alternate colors and can dispatch once at the root. Us must be the side to move,
+// for unmake_move the side that played the move. Instantiated for both colors in chess.cpp.
+template <ChessColor Us, GenType Type = GenType::All> int generate_legal_moves(const ChessState& state, ChessMove* moves);
+template <ChessColor Us> void make_move(ChessState* state, ChessMove move, ChessUndo* undo);
+template <ChessColor Us> void unmake_move(ChessState* state, ChessMove move, const ChessUndo& undo);
+
+// pieces of both colors attacking the square, sliders see through anything missing from occupied
+Bitboard attackers_to(const ChessState& state, SquareIndex square, Bitboard occupied);
+
+// Whether any piece of the given color attacks the square, looked up backwards from the square
+// and stopping at the first attacker found, nothing is generated.
+bool is_square_attacked(const ChessState& state, SquareIndex square, ChessColor by);
+// whether the king of the side to move is attacked, attackers_to masked with the other side
+bool in_check(const ChessState& state);
+
+// Attack maps from scratch, and the incremental update after the board changed. Only the pieces
+// on the touched squares and the sliders whose rays crossed a square that was emptied or filled
+// are recomputed, old_occupied is the occupancy before the change.
+void compute_attack_maps(ChessPosition* position, SquareMaps* maps);
+void update_attack_maps(ChessPosition* position, SquareMaps* maps, Bitboard old_occupied, Bitboard touched);
+
+// make_move and unmake_move that keep the attack maps up to date
+void make_move(ChessPosition* position, SquareMaps* maps, ChessMove move, ChessUndo* undo);
+void unmake_move(ChessPosition* position, SquareMaps* maps, ChessMove move, const ChessUndo& undo);
+
+// Zobrist keys of the positions before the current one, oldest first, pushed before every move
+// and popped after unmaking it. Only the last half_move of them can come back, anything before
+// a capture or pawn move is out of reach, so the checks below never look further than that.
+using KeyHistory = FixedArray<u64, MAX_GAME_PLY + MAX_SEARCH_PLY>;
+
+// The position occured before with the same side to move, enough for a search to score it as
+// a draw. Three-fold is the rule that ends a game, for adjudication.
+bool is_repetition(const ChessState& state, const KeyHistory& history);
+bool is_threefold_repetition(const ChessState& state, const KeyHistory& history);
+
+// 100 plies without a capture or pawn move, a checkmate on the last of them still counts as mate
+bool is_fifty_move_draw(const ChessState& state);
+
+// no sequence of legal moves can checkmate: kings with at most one minor piece between them,
+// or only bishops all on squares of one color
+bool has_insufficient_material(const ChessState& state);
+
+// helpers for square based input like clicking on the board, null_move() when nothing matches
+ChessMove find_move(const MoveList& moves, SquareIndex from, SquareIndex to, PieceType promotion = PieceType::Queen);
+Bitboard move_targets(const MoveList& moves, SquareIndex from);
+
 struct ChessGame {
     ChessPosition position = {};
-    DArray<ChessMove> moves = {};
+    SquareMaps maps = {};
+    FixedArray<ChessMove, MAX_GAME_PLY> moves = {};
+    FixedArray<ChessUndo, MAX_GAME_PLY> undo_stack = {};
+    KeyHistory key_history = {};
+    int redo_count = 0;  // undone moves still stored past the end of moves
+
+    MoveList legal_moves = {};
 
+    // promotions from the board always pick a queen
     bool make_move(SquareIndex from, SquareIndex to);
     bool undo_move();
+    bool redo_move();
 
-    bool set_position(ChessState state);
+    bool set_position(const ChessState& state);
     void calculate_moves();
-    void calculate_king_moves();
+
+    // three-fold, fifty moves or dead material, a checkmated side has no legal moves to draw with
+    bool is_draw() const;
+};
+
+// How the slider attack tables are indexed. Magic multiplies the relevant blockers with a
+// per square magic number and works everywhere, Pext packs the blocker bits with the bmi2
+// instruction and needs no magic numbers.
+enum class SliderBackend {
+    Magic,
+    Pext,
+};
+
+extern SliderBackend active_slider_backend;
+
+const char* slider_backend_name(SliderBackend backend);
+
+// the attack set of a slider is a single table lookup indexed by the relevant blockers
+struct SliderMagic {
+    Bitboard mask = 0;    // relevant occupancy, edges excluded
+    u64 magic = 0;
+    Bitboard* attacks = nullptr;
+    u32 shift = 0;
+
+    u32 index(Bitboard occupied) const
+    {
+#if HAS_PEXT
+        if (active_slider_backend == SliderBackend::Pext)
+            return u32(PARALLEL_BIT_EXTRACT(occupied, mask));
+#endif
+        return u32(((occupied & mask) * magic) >> shift);
+    }
 };
 
+extern SliderMagic rook_magics[64];
+extern SliderMagic bishop_magics[64];
+
+// squares strictly between two aligned squares and the whole line through them, zero when the
+// squares do not share a rank, file or diagonal. Filled by initialize_attack_tables.
+extern Bitboard between_squares[64][64];
+extern Bitboard line_squares[64][64];
+
+// must be called once before any move calculation, picks the backend from cpuid
+void initialize_attack_tables();
+// rebuilds the tables for the given backend, fails if the cpu does not support it
+bool set_slider_backend(SliderBackend backend);
+
+static inline Bitboard rook_attacks(SquareIndex square, Bitboard occupied)
+{
+    const SliderMagic& m = rook_magics[square];
+    return m.attacks[m.index(occupied)];
+}
+
+static inline Bitboard bishop_attacks(SquareIndex square, Bitboard occupied)
+{
+    const SliderMagic& m = bishop_magics[square];
+    return m.attacks[m.index(occupied)];
+}
+
+static inline Bitboard queen_attacks(SquareIndex square, Bitboard occupied)
+{
+    return rook_attacks(square, occupied) | bishop_attacks(square, occupied);
+}
+
 bool parse_fen_string(ChessState* state, String fen);
-ChessPosition calculate_position(ChessState state);
+
+// Parses the fen fields at the start of the text: placement, side to move, castling, en passant
+// and the two clocks if they are there, epd leaves them out. *consumed is where the fields end,
+// the state is reset first and fully filled, bitboards, mailbox and hash.
+bool parse_fen_fields(String text, ChessState* state, int* consumed);
+
+// longest fen write_fen produces, with the terminating zero
+#define MAX_FEN_LENGTH 96
+
+// writes the full fen of the state and a terminating zero, returns the length without it
+int write_fen(const ChessState& state, char buffer[MAX_FEN_LENGTH]);
+void calculate_position(const ChessState& state, ChessPosition* position, SquareMaps* maps);
 
 Bitboard calculate_orthogonal_moves(Bitboard pieces, Bitboard blockers, Bitboard captures);
 Bitboard calculate_diagonal_moves(Bitboard pieces, Bitboard blockers, Bitboard captures);
 Bitboard calculate_knight_moves(Bitboard pieces, Bitboard blockers, Bitboard captures);
-Bitboard calculate_pawn_moves(Bitboard pieces, Bitboard blockers, Bitboard captures);
+Bitboard calculate_pawn_moves(Bitboard pieces, Bitboard blockers, Bitboard captures, ChessColor color);
+
+// Set-wise versions for evaluation, where only the union over all pieces of a kind is wanted.
+// Occluded fills shift whole piece sets along each direction instead of looking up every
+// piece, so the cost is the same for one rook or four. Slider fills include the first
+// occupied square of each ray, like rook_attacks and bishop_attacks.
+Bitboard orthogonal_fill(Bitboard sliders, Bitboard empty);
+Bitboard diagonal_fill(Bitboard sliders, Bitboard empty);
+Bitboard knight_fill(Bitboard knights);
+Bitboard king_fill(Bitboard kings);
+Bitboard pawn_fill(Bitboard pawns, ChessColor color);
+
+// Same results as calculate_orthogonal_moves and calculate_diagonal_moves: the set of squares
+// the pieces attack, not a mobility count. A square two rooks reach is in it once.
+Bitboard calculate_orthogonal_moves_setwise(Bitboard pieces, Bitboard blockers, Bitboard captures);
+Bitboard calculate_diagonal_moves_setwise(Bitboard pieces, Bitboard blockers, Bitboard captures);
 
 SquareIndex parse_square(char rank, char file);
 
+// long algebraic notation like e2e4 or e7e8q, at most five characters and a terminator
+void move_to_string(ChessMove move, char buffer[6]);
+
 #endif // _CHESS_H
\ No newline at end of file
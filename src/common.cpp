@@ -3,6 +3,16 @@
 #include <cmath>
 #include <array>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 unsigned int pop_count(u64 x)
 {
@@ -12,7 +22,7 @@ unsigned int pop_count(u64 x)
     x = (x & (u64)0x00FF00FF00FF00FF) + ((x >> 8)  & (u64)0x00FF00FF00FF00FF);
     x = (x & (u64)0x0000FFFF0000FFFF) + ((x >> 16) & (u64)0x0000FFFF0000FFFF);
     x = (x & (u64)0x00000000FFFFFFFF) + ((x >> 32) & (u64)0x00000000FFFFFFFF);
-    return unsigned int(x);
+    return (unsigned int)x;
 }
 
 NORETURN
@@ -34,6 +44,68 @@ int pop_msb(u64* x) {
     return index;
 }
 
+#if defined(_M_X64) || defined(__x86_64__)
+#ifndef _MSC_VER
+#include <cpuid.h>
+#endif
+
+static void cpuid(u32 leaf, u32 subleaf, u32 registers[4])
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, int(leaf), int(subleaf));
+    for (int i = 0; i < 4; i++) registers[i] = u32(r[i]);
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// which register state the operating system saves on a context switch
+static u64 xgetbv0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    u32 low, high;
+    __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (u64(high) << 32) | low;
+#endif
+}
+
+CpuFeatures cpu_features()
+{
+    CpuFeatures features = {};
+
+    u32 r[4];
+    cpuid(0, 0, r);
+    u32 max_leaf = r[0];
+    bool is_amd = r[1] == 0x68747541;  // "Auth"enticAMD
+
+    if (max_leaf < 7)
+        return features;
+
+    cpuid(1, 0, r);
+    u32 family = (r[0] >> 8) & 0xf;
+    if (family == 0xf)
+        family += (r[0] >> 20) & 0xff;
+
+    // avx and osxsave, then the xmm and ymm state enabled by the os
+    bool ymm_saved = (r[2] & BIT(27)) && (r[2] & BIT(28)) && (xgetbv0() & 0x6) == 0x6;
+
+    cpuid(7, 0, r);
+    features.bmi2 = r[1] & BIT(8);
+    features.fast_pext = features.bmi2 && !(is_amd && family < 0x19);
+    features.avx2 = ymm_saved && (r[1] & BIT(5));
+
+    return features;
+}
+#else
+CpuFeatures cpu_features()
+{
+    return CpuFeatures();
+}
+#endif
+
 int string_length(const char* cstr) {
     return (int)strlen(cstr);
 }
@@ -201,6 +273,120 @@ bool load_file(const char* filepath, BinaryData& data) {
 	return true;
 }
 
+MappedFile::~MappedFile()
+{
+    unmap_file(this);
+}
+
+#ifdef _WIN32
+bool map_file(const char* filepath, MappedFile* file)
+{
+    unmap_file(file);
+
+    HANDLE handle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size))
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    // an empty file can not be mapped, it is still a valid empty view
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        file->data = "";
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view)
+    {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file->data = (const char*)view;
+    file->size = size.QuadPart;
+    file->file_handle = handle;
+    file->mapping_handle = mapping;
+    return true;
+}
+
+void unmap_file(MappedFile* file)
+{
+    if (file->mapping_handle)
+    {
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping_handle);
+        CloseHandle(file->file_handle);
+    }
+
+    file->data = nullptr;
+    file->size = 0;
+    file->file_handle = nullptr;
+    file->mapping_handle = nullptr;
+}
+#else
+bool map_file(const char* filepath, MappedFile* file)
+{
+    unmap_file(file);
+
+    int descriptor = open(filepath, O_RDONLY);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(descriptor, &info) != 0)
+    {
+        close(descriptor);
+        return false;
+    }
+
+    if (info.st_size == 0)
+    {
+        close(descriptor);
+        file->data = "";
+        return true;
+    }
+
+    void* view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);  // the mapping keeps the file open
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // read front to back once, let the kernel read ahead aggressively
+    madvise(view, size_t(info.st_size), MADV_SEQUENTIAL);
+
+    file->data = (const char*)view;
+    file->size = s64(info.st_size);
+    return true;
+}
+
+void unmap_file(MappedFile* file)
+{
+    if (file->size)
+    {
+        munmap((void*)file->data, size_t(file->size));
+    }
+
+    file->data = nullptr;
+    file->size = 0;
+}
+#endif
+
 bool load_file_text(const char* filepath, String_Builder& builder)
 {
 	FILE* handle = fopen(filepath, "rb");
@@ -60,6 +60,38 @@ static inline unsigned int msvc_leading_zeros(u64 x)
 
 #endif
 
+// BMI2 parallel bit extract. Only call this after cpu_features() reported bmi2.
+#if defined(_M_X64) || defined(__x86_64__)
+
+#define HAS_PEXT 1
+
+#ifdef _MSC_VER
+#define PARALLEL_BIT_EXTRACT(x, mask) _pext_u64(x, mask)
+#else
+// inline asm instead of the intrinsic so the caller does not need to be compiled for bmi2
+static inline u64 gcc_parallel_bit_extract(u64 x, u64 mask)
+{
+    u64 result;
+    __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(x), "rm"(mask));
+    return result;
+}
+#define PARALLEL_BIT_EXTRACT(x, mask) gcc_parallel_bit_extract(x, mask)
+#endif
+
+#else
+
+#define HAS_PEXT 0
+
+#endif
+
+struct CpuFeatures {
+    bool bmi2 = false;
+    bool fast_pext = false;  // zen 1 and 2 implement pext in microcode, it is slower than a multiply there
+    bool avx2 = false;       // includes the operating system saving the ymm registers
+};
+
+CpuFeatures cpu_features();
+
 #define ASSERT(x)   do {    \
         if (!(x)) {             \
             fprintf(stderr, "-----*****----- Assertion failed at %s:%d   %s\n", __FILE__, __LINE__, #x); \
@@ -260,6 +292,28 @@ bool load_file_text(const char* filepath, String_Builder& s);
 
 long get_file_size(FILE* file);
 
+// A read only view of a whole file through the page cache, nothing is copied until it is
+// touched. The data stays valid until unmap_file.
+struct MappedFile {
+    const char* data = nullptr;
+    s64 size = 0;
+
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    // the destructor unmaps, a copy would unmap the same view a second time
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+bool map_file(const char* filepath, MappedFile* file);
+void unmap_file(MappedFile* file);
+
 struct File {
 	FILE* handle = nullptr;
 
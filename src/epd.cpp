@@ -0,0 +1,104 @@
+#include "epd.hpp"
+
+void EpdReader::open(const char* data, s64 size)
+{
+    cursor = data;
+    end = data + size;
+    line = 0;
+    errors = 0;
+}
+
+static inline String trim_quotes(String operand)
+{
+    if (operand.size >= 2 && operand[0] == '"' && operand[operand.size - 1] == '"')
+        return String(operand.data + 1, operand.size - 2);
+    return operand;
+}
+
+// opcode operand ... ; opcode operand ... ;   a semicolon inside quotes does not end an operation
+static void parse_operations(String text, EpdRecord* record)
+{
+    int cursor = 0;
+    while (cursor < text.size)
+    {
+        while (cursor < text.size && text[cursor] == ' ')
+            cursor += 1;
+
+        int opcode_start = cursor;
+        while (cursor < text.size && text[cursor] != ' ' && text[cursor] != ';')
+            cursor += 1;
+        String opcode = String(text.data + opcode_start, cursor - opcode_start);
+
+        while (cursor < text.size && text[cursor] == ' ')
+            cursor += 1;
+
+        int operand_start = cursor;
+        bool quoted = false;
+        while (cursor < text.size && (quoted || text[cursor] != ';'))
+        {
+            if (text[cursor] == '"')
+                quoted = !quoted;
+            cursor += 1;
+        }
+
+        int operand_end = cursor;
+        while (operand_end > operand_start && text[operand_end - 1] == ' ')
+            operand_end -= 1;
+        String operand = String(text.data + operand_start, operand_end - operand_start);
+
+        cursor += 1;  // the semicolon
+
+        if (opcode.size != 2)
+            continue;
+
+        // two character opcodes compared as one 16 bit value
+        u16 code = u16(u8(opcode[0]) | (u8(opcode[1]) << 8));
+        switch (code)
+        {
+            case 'b' | ('m' << 8): record->best_moves = operand; break;
+            case 'a' | ('m' << 8): record->avoid_moves = operand; break;
+            case 'i' | ('d' << 8): record->id = trim_quotes(operand); break;
+            case 'c' | ('0' << 8): record->comment = trim_quotes(operand); break;
+            default: break;
+        }
+    }
+}
+
+bool EpdReader::next(EpdRecord* record)
+{
+    while (cursor < end)
+    {
+        const char* line_end = (const char*)memchr(cursor, '\n', size_t(end - cursor));
+        if (!line_end)
+            line_end = end;
+
+        String text = String(cursor, int(line_end - cursor));
+        cursor = line_end < end ? line_end + 1 : end;
+        line += 1;
+
+        if (text.size && text[text.size - 1] == '\r')
+            text.size -= 1;
+        if (!text.size)
+            continue;
+
+        int consumed = 0;
+        if (!parse_fen_fields(text, &record->state, &consumed))
+        {
+            errors += 1;
+            continue;
+        }
+
+        record->best_moves = {};
+        record->avoid_moves = {};
+        record->id = {};
+        record->comment = {};
+        record->line = line;
+
+        if (consumed < text.size)
+            parse_operations(String(text.data + consumed, text.size - consumed), record);
+
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,30 @@
+#ifndef _EPD_H
+#define _EPD_H
+
+#include "chess.hpp"
+
+// One position of an epd or fen file. The opcodes are slices of the file itself, nothing is
+// copied, so they are only valid while the file stays mapped. Missing opcodes are empty.
+struct EpdRecord {
+    ChessState state;
+    String best_moves = {};   // bm, one or more moves in san
+    String avoid_moves = {};  // am
+    String id = {};           // without the quotes
+    String comment = {};      // c0, without the quotes
+    int line = 0;
+};
+
+// Walks a buffer of epd or fen lines, usually a mapped file, one record at a time without
+// allocating. Lines that do not parse are skipped and counted.
+struct EpdReader {
+    const char* cursor = nullptr;
+    const char* end = nullptr;
+    int line = 0;
+    int errors = 0;
+
+    void open(const char* data, s64 size);
+    // false once the input is used up
+    bool next(EpdRecord* record);
+};
+
+#endif // _EPD_H
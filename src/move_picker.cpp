@@ -0,0 +1,279 @@
+#include "move_picker.hpp"
+
+#include <string.h>
+
+static const char* PickerStageNames[int(PickerStage::Count)] = {
+    "hash move",
+    "generate captures",
+    "captures",
+    "killers",
+    "generate quiets",
+    "quiets",
+    "done",
+};
+
+const char* picker_stage_name(PickerStage stage)
+{
+    return PickerStageNames[int(stage)];
+}
+
+void PickerStats::clear()
+{
+    for (u64& count : reached)
+    {
+        count = 0;
+    }
+}
+
+void PickerStats::operator+=(const PickerStats& other)
+{
+    for (int i = 0; i < int(PickerStage::Count); i++)
+    {
+        reached[i] += other.reached[i];
+    }
+}
+
+void PickerStats::print() const
+{
+    u64 total = reached[int(PickerStage::HashMove)];
+    for (int i = 0; i < int(PickerStage::Count); i++)
+    {
+        printf("  %-18s %12llu  %5.1f%%\n", PickerStageNames[i], (unsigned long long)reached[i],
+               total ? 100.0 * reached[i] / total : 0.0);
+    }
+}
+
+void OrderingStats::print() const
+{
+    printf("  cutoffs            %12llu\n", (unsigned long long)cutoffs);
+    printf("  on the first move  %12llu  %5.1f%%\n", (unsigned long long)first_move_cutoffs,
+           cutoffs ? 100.0 * first_move_cutoffs / cutoffs : 0.0);
+}
+
+void OrderingStats::operator+=(const OrderingStats& other)
+{
+    cutoffs += other.cutoffs;
+    first_move_cutoffs += other.first_move_cutoffs;
+}
+
+void MoveHistory::clear()
+{
+    memset(this, 0, sizeof(MoveHistory));
+}
+
+// Piece ranks for most valuable victim, least valuable attacker. A victim outweighs any attacker
+// and the king is the last piece to take with.
+static const int MvvLvaRank[PieceType::Count] = {
+    6,  // King
+    5,  // Queen
+    4,  // Rook
+    3,  // Bishop
+    2,  // Knight
+    1,  // Pawn
+};
+
+MovePicker::MovePicker(const ChessState& state, ChessMove hash_move, const ChessMove* killers, PickerStats* stats,
+                       const QuietOrdering* ordering)
+    : m_state(state), m_stats(stats), m_hash_move(hash_move), m_ordering(ordering)
+{
+    enter(PickerStage::HashMove);
+
+    if (!killers)
+        return;
+
+    // killers are quiet moves by definition, anything else is picked up by the capture stage
+    for (int i = 0; i < KILLER_SLOTS; i++)
+    {
+        ChessMove killer = killers[i];
+        if (killer.is_null() || killer == hash_move || killer.kind() == MoveKind::Promotion ||
+            killer.kind() == MoveKind::EnPassant || state.piece_on(killer.to()) != PieceType::Sentinel)
+        {
+            continue;
+        }
+
+        if (m_killer_count == 1 && killer == m_killers[0])
+            continue;
+
+        m_killers[m_killer_count++] = killer;
+    }
+}
+
+MovePicker::MovePicker(const ChessState& state, CapturesOnly)
+    : m_state(state), m_captures_only(true), m_hash_move(null_move())
+{
+    enter(PickerStage::HashMove);
+}
+
+MovePicker MovePicker::captures_only(const ChessState& state)
+{
+    return MovePicker(state, CapturesOnly());
+}
+
+void MovePicker::score_captures()
+{
+    for (int i = 0; i < m_moves.size(); i++)
+    {
+        ChessMove move = m_moves[i];
+        PieceType victim = move.kind() == MoveKind::EnPassant ? PieceType::Pawn : m_state.piece_on(move.to());
+
+        int score = victim == PieceType::Sentinel ? 0 : 8 * MvvLvaRank[victim] - MvvLvaRank[m_state.piece_on(move.from())];
+        // a promotion counts like taking the new piece, underpromotions end up behind most captures
+        if (move.kind() == MoveKind::Promotion)
+            score += 8 * MvvLvaRank[move.promotion()] - MvvLvaRank[PieceType::Pawn];
+
+        m_scores[i] = score;
+    }
+}
+
+void MovePicker::score_quiets()
+{
+    if (!m_ordering)
+    {
+        for (int i = 0; i < m_moves.size(); i++)
+            m_scores[i] = 0;
+        return;
+    }
+
+    for (int i = 0; i < m_moves.size(); i++)
+    {
+        ChessMove move = m_moves[i];
+        int piece_to = piece_to_index(m_state, move);
+
+        int score = m_ordering->butterfly[move.data & 0xfff];
+        for (const s16* row : m_ordering->continuation)
+        {
+            if (row)
+                score += row[piece_to];
+        }
+
+        // above anything the three tables can add up to
+        if (move == m_ordering->counter_move)
+            score += 4 * MAX_HISTORY;
+
+        m_scores[i] = score;
+    }
+}
+
+ChessMove MovePicker::pick_best()
+{
+    int best = m_index;
+    for (int i = m_index + 1; i < m_moves.size(); i++)
+    {
+        if (m_scores[i] > m_scores[best])
+            best = i;
+    }
+
+    ChessMove move = m_moves[best];
+    m_moves[best] = m_moves[m_index];
+    m_scores[best] = m_scores[m_index];
+    m_index += 1;
+    return move;
+}
+
+void MovePicker::enter(PickerStage stage)
+{
+    m_stage = stage;
+    if (m_stats)
+        m_stats->reached[int(stage)] += 1;
+}
+
+bool MovePicker::was_picked_early(ChessMove move) const
+{
+    if (move == m_hash_move)
+        return true;
+
+    for (int i = 0; i < m_killer_index; i++)
+    {
+        if (move == m_killers[i])
+            return true;
+    }
+
+    return false;
+}
+
+ChessMove MovePicker::next()
+{
+    switch (m_stage)
+    {
+        case PickerStage::HashMove:
+        {
+            enter(PickerStage::GenerateCaptures);
+            if (!m_hash_move.is_null() && is_legal_move(m_state, m_hash_move))
+                return m_hash_move;
+
+            // nothing to hand out, the hash move can not match a generated move either
+            m_hash_move = null_move();
+        }
+        [[fallthrough]];
+
+        case PickerStage::GenerateCaptures:
+        {
+            m_moves.set_size(generate_captures(m_state, m_moves.data()));
+            m_index = 0;
+            score_captures();
+            enter(PickerStage::Captures);
+        }
+        [[fallthrough]];
+
+        case PickerStage::Captures:
+        {
+            while (m_index < m_moves.size())
+            {
+                ChessMove move = pick_best();
+                if (move != m_hash_move)
+                    return move;
+            }
+
+            if (m_captures_only)
+            {
+                enter(PickerStage::Done);
+                return null_move();
+            }
+            enter(PickerStage::Killers);
+        }
+        [[fallthrough]];
+
+        case PickerStage::Killers:
+        {
+            while (m_killer_index < m_killer_count)
+            {
+                ChessMove killer = m_killers[m_killer_index];
+                if (is_legal_move(m_state, killer))
+                {
+                    m_killer_index += 1;
+                    return killer;
+                }
+
+                // an illegal killer is dropped so the quiet stage does not skip it
+                m_killers[m_killer_index] = m_killers[--m_killer_count];
+            }
+            enter(PickerStage::GenerateQuiets);
+        }
+        [[fallthrough]];
+
+        case PickerStage::GenerateQuiets:
+        {
+            m_moves.set_size(generate_quiets(m_state, m_moves.data()));
+            m_index = 0;
+            score_quiets();
+            enter(PickerStage::Quiets);
+        }
+        [[fallthrough]];
+
+        case PickerStage::Quiets:
+        {
+            while (m_index < m_moves.size())
+            {
+                ChessMove move = pick_best();
+                if (!was_picked_early(move))
+                    return move;
+            }
+            enter(PickerStage::Done);
+        }
+        [[fallthrough]];
+
+        case PickerStage::Done:
+        default:
+            return null_move();
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef _MOVE_PICKER_H
+#define _MOVE_PICKER_H
+
+#include "chess.hpp"
+
+// Stages in the order the picker walks through them. The generate stages only run once the
+// stage before is used up, so a node that cuts off on the hash move or a capture never pays
+// for the quiet moves.
+enum class PickerStage : u8 {
+    HashMove,
+    GenerateCaptures,
+    Captures,
+    Killers,
+    GenerateQuiets,
+    Quiets,
+    Done,
+    Count,
+};
+
+const char* picker_stage_name(PickerStage stage);
+
+// how often each stage was entered, owned by the caller so threads do not share the counters
+struct PickerStats {
+    u64 reached[int(PickerStage::Count)] = {};
+
+    void clear();
+    void print() const;
+    void operator+=(const PickerStats& other);
+};
+
+// beta cutoffs of the search and how many the first move tried was good for, the share of
+// those is how well the moves are ordered
+struct OrderingStats {
+    u64 cutoffs = 0;
+    u64 first_move_cutoffs = 0;
+
+    void print() const;
+    void operator+=(const OrderingStats& other);
+};
+
+#define KILLER_SLOTS 2
+
+// history scores stay within plus and minus this
+#define MAX_HISTORY 16384
+
+// Gravity update: the further the score already is in the direction of the bonus, the less it
+// moves, so it never leaves the range and old results fade as new ones come in.
+static inline void apply_history_bonus(s16* entry, int bonus)
+{
+    int clamped = CLAMP(bonus, -MAX_HISTORY, MAX_HISTORY);
+    *entry += s16(clamped - *entry * (clamped < 0 ? -clamped : clamped) / MAX_HISTORY);
+}
+
+// The moving piece with its color and the target square, (color * 6 + type) * 64 + to. Counter
+// moves and continuation history are indexed by it, what a move does depends more on the piece
+// landing on the square than on where it came from. Taken before the move is made.
+#define PIECE_TO_COUNT (2 * PieceType::Count * 64)
+
+static inline int piece_to_index(const ChessState& state, ChessMove move)
+{
+    return (int(state.side_to_move) * PieceType::Count + state.piece_on(move.from())) * 64 + move.to();
+}
+
+// Everything the search learns about quiet moves, one set per search thread so nothing is
+// shared. Flat arrays indexed straight by the packed move or the piece-to index, cache line
+// aligned like the Searcher that owns it.
+struct alignas(64) MoveHistory {
+    ChessMove killers[MAX_SEARCH_PLY][KILLER_SLOTS];
+    // by side to move and from | to << 6, the low 12 bits of the packed move
+    s16 butterfly[2][64 * 64];
+    // the quiet move that last refuted a move, by that move's piece-to
+    ChessMove counter_moves[PIECE_TO_COUNT];
+    // by the piece-to of the move one or two plies back and the one of this move, the color in
+    // the index keeps the two apart
+    s16 continuation[PIECE_TO_COUNT][PIECE_TO_COUNT];
+
+    void clear();
+};
+
+// what the quiet stage sorts by, the rows come out of a MoveHistory
+struct QuietOrdering {
+    const s16* butterfly = nullptr;
+    const s16* continuation[2] = {};  // one and two plies back, null where there was no move
+    ChessMove counter_move = null_move();
+};
+
+// Yields every legal move of the state exactly once: the hash move, captures and promotions
+// best victim and cheapest attacker first, the killers, then the remaining quiet moves by their
+// history with the counter move in front. The hash move and killers come from elsewhere and are
+// checked with is_legal_move before they are handed out. Without an ordering the quiet moves
+// come in generation order.
+struct MovePicker {
+    MovePicker(const ChessState& state, ChessMove hash_move, const ChessMove* killers = nullptr,
+               PickerStats* stats = nullptr, const QuietOrdering* ordering = nullptr);
+
+    // Captures and promotions only, done right after the capture stage, for the quiescence
+    // search. Not counted in any stats.
+    static MovePicker captures_only(const ChessState& state);
+
+    // null_move() once every move was returned
+    ChessMove next();
+
+    PickerStage stage() const { return m_stage; }
+
+private:
+    struct CapturesOnly {};
+    MovePicker(const ChessState& state, CapturesOnly);
+
+    void enter(PickerStage stage);
+    bool was_picked_early(ChessMove move) const;
+    void score_captures();
+    void score_quiets();
+    // selection sort one step at a time, most nodes never look past the first few moves
+    ChessMove pick_best();
+
+    const ChessState& m_state;
+    PickerStats* m_stats = nullptr;
+    PickerStage m_stage = PickerStage::HashMove;
+    bool m_captures_only = false;
+
+    ChessMove m_hash_move;
+    ChessMove m_killers[KILLER_SLOTS];
+    int m_killer_count = 0;
+    int m_killer_index = 0;
+
+    const QuietOrdering* m_ordering = nullptr;
+
+    MoveList m_moves;
+    int m_scores[MAX_MOVES];
+    int m_index = 0;
+};
+
+#endif // _MOVE_PICKER_H
@@ -0,0 +1,570 @@
+#include "chess.hpp"
+#include "log.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+
+// Move generator correctness and speed check, counts the leaf nodes of the legal move tree.
+//
+// usage: perft [options] <depth> [fen]      divide counts for every root move, start position by default
+//        perft [options] suite [max_depth]  the reference positions against their known counts
+//
+// options: --threads N  split the tree over N threads, 1 by default
+//          --split P    ply the tree is split at in parallel mode, 2 by default
+//          --scaling    time the run for 1, 2, 4 .. N threads and report the speed-up
+//          --hash MB    cache subtree counts by zobrist key and depth, shared by all threads
+//          --compare    with --hash, run without the cache first and report the speed-up
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+struct PerftReference {
+    const char* name;
+    const char* fen;
+    u64 nodes[8];  // by depth starting at 1, zero past the last known count
+    int suite_depth;
+};
+
+static const PerftReference PerftSuite[] = {
+    { "startpos", START_FEN,
+      { 20, 400, 8902, 197281, 4865609, 119060324 }, 6 },
+    { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      { 48, 2039, 97862, 4085603, 193690690 }, 5 },
+    { "position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      { 14, 191, 2812, 43238, 674624, 11030083, 178633661 }, 7 },
+    { "position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      { 6, 264, 9467, 422333, 15833292, 706045033 }, 5 },
+    { "position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      { 44, 1486, 62379, 2103487, 89941194 }, 5 },
+    { "position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      { 46, 2079, 89890, 3894594, 164075551 }, 5 },
+};
+
+static double elapsed_seconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Subtree counts by position and remaining depth. Entries are written without locks: each one
+// keeps key ^ data next to data, so a write torn by another thread fails the check and reads
+// as a miss instead of a wrong count.
+struct PerftHash {
+    struct Entry {
+        std::atomic<u64> check;
+        std::atomic<u64> data;  // node count above the low 8 bits, depth in them
+    };
+
+    Entry* entries = nullptr;
+    u64 mask = 0;
+
+    bool allocate(int megabytes)
+    {
+        release();
+
+        u64 count = 1;
+        while (count * 2 * sizeof(Entry) <= u64(megabytes) << 20)
+        {
+            count *= 2;
+        }
+
+        if (count * sizeof(Entry) > u64(megabytes) << 20)
+        {
+            return false;
+        }
+
+        entries = new Entry[count];
+        mask = count - 1;
+        clear();
+        return true;
+    }
+
+    void release()
+    {
+        delete[] entries;
+        entries = nullptr;
+        mask = 0;
+    }
+
+    void clear()
+    {
+        for (u64 i = 0; i <= mask; i++)
+        {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // every depth of a position gets its own slot
+    Entry& slot(u64 key, int depth) const
+    {
+        return entries[(key ^ (u64(depth) * 0x9e3779b97f4a7c15ull)) & mask];
+    }
+
+    bool probe(u64 key, int depth, u64* nodes) const
+    {
+        Entry& entry = slot(key, depth);
+        u64 data = entry.data.load(std::memory_order_relaxed);
+        u64 check = entry.check.load(std::memory_order_relaxed);
+
+        if ((check ^ data) != key || int(data & 0xff) != depth)
+        {
+            return false;
+        }
+
+        *nodes = data >> 8;
+        return true;
+    }
+
+    void store(u64 key, int depth, u64 nodes)
+    {
+        Entry& entry = slot(key, depth);
+        u64 data = (nodes << 8) | u64(depth);
+        entry.check.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+
+    ~PerftHash() { release(); }
+};
+
+struct PerftStats {
+    u64 probes = 0;
+    u64 hits = 0;
+
+    void operator+=(const PerftStats& other)
+    {
+        probes += other.probes;
+        hits += other.hits;
+    }
+};
+
+// the last ply is never played, the size of the move list is the count
+template <ChessColor Us>
+static u64 perft(ChessState* state, int depth, PerftHash* hash, PerftStats* stats)
+{
+    MoveList moves;
+    moves.set_size(generate_legal_moves<Us>(*state, moves.data()));
+
+    if (depth <= 1)
+    {
+        return depth == 1 ? moves.size() : 1;
+    }
+
+    // bulk counted leaves are cheaper than a probe, only look up the larger subtrees
+    if (hash)
+    {
+        u64 cached = 0;
+        stats->probes += 1;
+        if (hash->probe(state->hash, depth, &cached))
+        {
+            stats->hits += 1;
+            return cached;
+        }
+    }
+
+    u64 nodes = 0;
+    for (ChessMove move : moves)
+    {
+        ChessUndo undo;
+        make_move<Us>(state, move, &undo);
+        nodes += perft<opposite_color(Us)>(state, depth - 1, hash, stats);
+        unmake_move<Us>(state, move, undo);
+    }
+
+    if (hash)
+    {
+        hash->store(state->hash, depth, nodes);
+    }
+
+    return nodes;
+}
+
+// the only place the side to move is looked at, everything below knows it at compile time
+static u64 perft(ChessState* state, int depth, PerftHash* hash, PerftStats* stats)
+{
+    return state->side_to_move == ChessColor::White
+        ? perft<ChessColor::White>(state, depth, hash, stats)
+        : perft<ChessColor::Black>(state, depth, hash, stats);
+}
+
+struct PerftOptions {
+    int threads = 1;
+    int split_ply = 2;
+    bool scaling = false;
+    int hash_megabytes = 0;
+    bool compare = false;
+};
+
+// an independent subtree, with its own copy of the state so workers share nothing but the hash
+struct PerftTask {
+    ChessState state;
+    int depth = 0;
+    int root_index = 0;
+    u64 nodes = 0;
+    PerftHash* hash = nullptr;
+    PerftStats stats;
+};
+
+static void run_perft_task(void* data)
+{
+    PerftTask* task = (PerftTask*)data;
+    task->nodes = perft(&task->state, task->depth, task->hash, &task->stats);
+}
+
+static void collect_tasks(ChessState* state, int ply, int split_ply, int depth, int root_index, DArray<PerftTask>* tasks)
+{
+    if (ply == split_ply)
+    {
+        PerftTask task;
+        task.state = *state;
+        task.depth = depth;
+        task.root_index = root_index;
+        tasks->add(task);
+        return;
+    }
+
+    MoveList moves;
+    generate_legal_moves(*state, &moves);
+
+    for (int i = 0; i < moves.size(); i++)
+    {
+        ChessUndo undo;
+        make_move(state, moves[i], &undo);
+        collect_tasks(state, ply + 1, split_ply, depth - 1, ply == 0 ? i : root_index, tasks);
+        unmake_move(state, moves[i], undo);
+    }
+}
+
+// Node counts under every root move. With more than one thread the tree is cut at the split
+// ply and every position there becomes a task on the pool, the counts are summed per root move.
+static u64 divide(ChessState* state, int depth, const PerftOptions& options, ThreadPool* pool, PerftHash* hash,
+                  PerftStats* stats, u64 root_counts[MAX_MOVES])
+{
+    MoveList moves;
+    generate_legal_moves(*state, &moves);
+
+    for (int i = 0; i < moves.size(); i++)
+    {
+        root_counts[i] = 0;
+    }
+
+    if (options.threads <= 1 || depth < 2)
+    {
+        for (int i = 0; i < moves.size(); i++)
+        {
+            ChessUndo undo;
+            make_move(state, moves[i], &undo);
+            root_counts[i] = perft(state, depth - 1, hash, stats);
+            unmake_move(state, moves[i], undo);
+        }
+    }
+    else
+    {
+        int split_ply = CLAMP(options.split_ply, 1, depth - 1);
+
+        DArray<PerftTask> tasks;
+        collect_tasks(state, 0, split_ply, depth, 0, &tasks);
+
+        for (PerftTask& task : tasks)
+        {
+            task.hash = hash;
+            pool->submit({ run_perft_task, &task });
+        }
+        pool->wait();
+
+        for (const PerftTask& task : tasks)
+        {
+            root_counts[task.root_index] += task.nodes;
+            *stats += task.stats;
+        }
+
+        tasks.free();
+    }
+
+    u64 nodes = 0;
+    for (int i = 0; i < moves.size(); i++)
+    {
+        nodes += root_counts[i];
+    }
+
+    return nodes;
+}
+
+static u64 perft_parallel(ChessState* state, int depth, const PerftOptions& options, ThreadPool* pool, PerftHash* hash,
+                         PerftStats* stats)
+{
+    u64 root_counts[MAX_MOVES];
+    return divide(state, depth, options, pool, hash, stats, root_counts);
+}
+
+static void print_hash_stats(const PerftStats& stats)
+{
+    printf("hash probes %llu  hits %llu  hit rate %.1f%%\n", (unsigned long long)stats.probes,
+           (unsigned long long)stats.hits, stats.probes ? 100.0 * stats.hits / stats.probes : 0.0);
+}
+
+static void start_pool(ThreadPool* pool, int threads)
+{
+    if (threads > 1)
+        pool->start(threads);
+    else
+        pool->stop();
+}
+
+// same count timed for 1, 2, 4 .. threads, up to and including the requested count
+static void run_scaling(ChessState* state, int depth, const PerftOptions& options)
+{
+    ThreadPool pool;
+    double single_thread_seconds = 0;
+
+    printf("threads        nodes      time      Mnps  speed-up\n");
+
+    for (int threads = 1; ; threads = MIN(threads * 2, options.threads))
+    {
+        PerftOptions run = options;
+        run.threads = threads;
+        start_pool(&pool, threads);
+
+        PerftHash hash;
+        if (options.hash_megabytes)
+            hash.allocate(options.hash_megabytes);
+
+        PerftStats stats;
+        auto start = std::chrono::steady_clock::now();
+        u64 nodes = perft_parallel(state, depth, run, &pool, hash.entries ? &hash : nullptr, &stats);
+        double seconds = elapsed_seconds(start);
+
+        if (threads == 1)
+            single_thread_seconds = seconds;
+
+        printf("%7d %12llu %8.3f s %9.2f %8.2fx\n", threads, (unsigned long long)nodes, seconds,
+               nodes / seconds / 1e6, single_thread_seconds / seconds);
+
+        if (threads >= options.threads)
+            break;
+    }
+}
+
+static bool run_divide(String fen, int depth, const PerftOptions& options)
+{
+    ChessState state;
+    if (!parse_fen_string(&state, fen))
+    {
+        log_error("Could not parse fen %.*s", fen.size, fen.data);
+        return false;
+    }
+
+    if (options.scaling)
+    {
+        run_scaling(&state, depth, options);
+        return true;
+    }
+
+    ThreadPool pool;
+    start_pool(&pool, options.threads);
+
+    MoveList moves;
+    generate_legal_moves(state, &moves);
+
+    u64 root_counts[MAX_MOVES];
+    PerftStats stats;
+
+    double unhashed_seconds = 0;
+    if (options.compare && options.hash_megabytes)
+    {
+        auto start = std::chrono::steady_clock::now();
+        u64 nodes = divide(&state, depth, options, &pool, nullptr, &stats, root_counts);
+        unhashed_seconds = elapsed_seconds(start);
+        printf("without hash: nodes %llu  time %.3f s  %.2f Mnps\n", (unsigned long long)nodes, unhashed_seconds,
+               nodes / unhashed_seconds / 1e6);
+    }
+
+    PerftHash hash;
+    if (options.hash_megabytes && !hash.allocate(options.hash_megabytes))
+    {
+        log_error("Could not allocate a %d MB hash", options.hash_megabytes);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    u64 nodes = divide(&state, depth, options, &pool, hash.entries ? &hash : nullptr, &stats, root_counts);
+    double seconds = elapsed_seconds(start);
+
+    for (int i = 0; i < moves.size(); i++)
+    {
+        char name[6];
+        move_to_string(moves[i], name);
+        printf("%s: %llu\n", name, (unsigned long long)root_counts[i]);
+    }
+
+    printf("\nnodes %llu  time %.3f s  %.2f Mnps  threads %d\n", (unsigned long long)nodes, seconds,
+           nodes / seconds / 1e6, options.threads);
+
+    if (hash.entries)
+    {
+        print_hash_stats(stats);
+        if (unhashed_seconds > 0)
+            printf("speed-up over the unhashed run %.2fx\n", unhashed_seconds / seconds);
+    }
+
+    return true;
+}
+
+static bool run_suite(int max_depth, const PerftOptions& options)
+{
+    bool all_passed = true;
+    u64 total_nodes = 0;
+    double total_seconds = 0;
+
+    ThreadPool pool;
+    start_pool(&pool, options.threads);
+
+    PerftHash hash;
+    if (options.hash_megabytes && !hash.allocate(options.hash_megabytes))
+    {
+        log_error("Could not allocate a %d MB hash", options.hash_megabytes);
+        return false;
+    }
+
+    PerftStats stats;
+
+    for (const PerftReference& reference : PerftSuite)
+    {
+        ChessState state;
+        if (!parse_fen_string(&state, String(reference.fen)))
+        {
+            log_error("Could not parse fen of %s", reference.name);
+            all_passed = false;
+            continue;
+        }
+
+        int depth = MIN(reference.suite_depth, max_depth);
+
+        if (options.scaling)
+        {
+            printf("%s depth %d\n", reference.name, depth);
+            run_scaling(&state, depth, options);
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        u64 nodes = perft_parallel(&state, depth, options, &pool, hash.entries ? &hash : nullptr, &stats);
+        double seconds = elapsed_seconds(start);
+
+        u64 expected = reference.nodes[depth - 1];
+        bool passed = nodes == expected;
+        all_passed = all_passed && passed;
+
+        total_nodes += nodes;
+        total_seconds += seconds;
+
+        printf("%-12s depth %d  %12llu  %s  %7.3f s  %8.2f Mnps\n", reference.name, depth,
+               (unsigned long long)nodes, passed ? "ok  " : "FAIL", seconds, nodes / seconds / 1e6);
+        if (!passed)
+        {
+            printf("             expected %llu\n", (unsigned long long)expected);
+        }
+    }
+
+    if (options.scaling)
+        return true;
+
+    printf("\ntotal %llu nodes  %.3f s  %.2f Mnps  threads %d  %s\n", (unsigned long long)total_nodes, total_seconds,
+           total_nodes / total_seconds / 1e6, options.threads, all_passed ? "all passed" : "FAILED");
+
+    if (hash.entries)
+        print_hash_stats(stats);
+
+    return all_passed;
+}
+
+static bool parse_number(const char* arg, int min, int max, int* value)
+{
+    bool success = false;
+    *value = string_to_integer(String(arg), &success);
+    if (!success || *value < min || *value > max)
+    {
+        log_error("Invalid number %s, expected %d to %d", arg, min, max);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    PerftOptions options;
+    bool threads_given = false;
+    const char* positional[2] = {};
+    int positional_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        String arg = String(argv[i]);
+        if (string_compare(arg, make_string("--threads")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, 1024, &options.threads))
+                return 1;
+            threads_given = true;
+        }
+        else if (string_compare(arg, make_string("--split")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, 20, &options.split_ply))
+                return 1;
+        }
+        else if (string_compare(arg, make_string("--scaling")))
+        {
+            options.scaling = true;
+        }
+        else if (string_compare(arg, make_string("--hash")) && i + 1 < argc)
+        {
+            if (!parse_number(argv[++i], 1, 1 << 20, &options.hash_megabytes))
+                return 1;
+        }
+        else if (string_compare(arg, make_string("--compare")))
+        {
+            options.compare = true;
+        }
+        else if (positional_count < 2)
+        {
+            positional[positional_count++] = argv[i];
+        }
+        else
+        {
+            log_error("Unexpected argument %s", argv[i]);
+            return 1;
+        }
+    }
+
+    if (positional_count < 1)
+    {
+        fprintf(stderr, "usage: %s [--threads N] [--split P] [--scaling] [--hash MB [--compare]] <depth> [fen]\n", argv[0]);
+        fprintf(stderr, "       %s [--threads N] [--split P] [--scaling] [--hash MB] suite [max_depth]\n", argv[0]);
+        return 1;
+    }
+
+    // scaling runs up to every core unless told otherwise
+    if (options.scaling && !threads_given)
+    {
+        options.threads = MAX(int(std::thread::hardware_concurrency()), 1);
+    }
+
+    initialize_attack_tables();
+    printf("slider backend: %s\n", slider_backend_name(active_slider_backend));
+
+    if (string_compare(String(positional[0]), make_string("suite")))
+    {
+        int max_depth = 20;
+        if (positional_count > 1 && !parse_number(positional[1], 1, 20, &max_depth))
+            return 1;
+
+        return run_suite(max_depth, options) ? 0 : 1;
+    }
+
+    int depth = 0;
+    if (!parse_number(positional[0], 1, 20, &depth))
+        return 1;
+
+    String fen = positional_count > 1 ? String(positional[1]) : make_string(START_FEN);
+    return run_divide(fen, depth, options) ? 0 : 1;
+}
@@ -0,0 +1,590 @@
+#include "search.hpp"
+
+#include "see.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+static double elapsed_seconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void print_search_report(const SearchReport& report)
+{
+    printf("depth %2d  ", report.depth);
+    if (report.score >= MATE_THRESHOLD || report.score <= -MATE_THRESHOLD)
+    {
+        // moves rather than plies, negative when the side to move is the one getting mated
+        int plies = MATE_SCORE - (report.score > 0 ? report.score : -report.score);
+        printf("score mate %3d  ", report.score > 0 ? (plies + 1) / 2 : -(plies / 2));
+    }
+    else
+    {
+        printf("score cp %5d  ", report.score);
+    }
+
+    printf("nodes %10llu  qnodes %4.1f%%  nps %9.0f  time %7.3f s  hashfull %4d  pv", (unsigned long long)report.nodes,
+           report.nodes ? 100.0 * report.qnodes / report.nodes : 0.0,
+           report.seconds > 0 ? report.nodes / report.seconds : 0.0, report.seconds, report.hashfull);
+
+    for (int i = 0; i < report.pv_length; i++)
+    {
+        char name[6];
+        move_to_string(report.pv[i], name);
+        printf(" %s", name);
+    }
+    printf("\n");
+}
+
+int evaluate(const ChessState& state)
+{
+    // from white's point of view until the end
+    int score = 0;
+    for (int type = PieceType::Queen; type <= PieceType::Pawn; type++)
+    {
+        Bitboard pieces = state.pieces[type];
+        score += see_piece_values[type] * (POP_COUNT(pieces & state.white) - POP_COUNT(pieces & state.black));
+    }
+
+    constexpr Bitboard Centre = 0x0000001818000000ull;      // d4 e4 d5 e5
+    constexpr Bitboard WideCentre = 0x00003c3c3c3c0000ull;  // c3 to f6
+    constexpr Bitboard WhiteAdvanced = 0x00ffffff00000000ull;  // ranks 5 to 7
+    constexpr Bitboard BlackAdvanced = 0x00000000ffffff00ull;  // ranks 2 to 4
+
+    // knights and bishops do the most from the middle, pawns count more the closer they get to promoting
+    Bitboard minors = state.pieces[PieceType::Knight] | state.pieces[PieceType::Bishop];
+    Bitboard pawns = state.pieces[PieceType::Pawn];
+    score += 10 * (POP_COUNT(minors & state.white & WideCentre) - POP_COUNT(minors & state.black & WideCentre));
+    score += 10 * (POP_COUNT((minors | pawns) & state.white & Centre) - POP_COUNT((minors | pawns) & state.black & Centre));
+    score += 15 * (POP_COUNT(pawns & state.white & WhiteAdvanced) - POP_COUNT(pawns & state.black & BlackAdvanced));
+
+    return state.side_to_move == ChessColor::White ? score : -score;
+}
+
+// Mates are stored as the distance from the node instead of the root, the same position is
+// reached at different plies and the stored score has to be right for all of them.
+static int score_to_table(int score, int ply)
+{
+    if (score >= MATE_THRESHOLD)
+        return score + ply;
+    if (score <= -MATE_THRESHOLD)
+        return score - ply;
+    return score;
+}
+
+static int score_from_table(int score, int ply)
+{
+    if (score >= MATE_THRESHOLD)
+        return score - ply;
+    if (score <= -MATE_THRESHOLD)
+        return score + ply;
+    return score;
+}
+
+bool Searcher::should_stop()
+{
+    if ((m_nodes & (STOP_POLL_NODES - 1)) == 0)
+    {
+        published_nodes.store(m_nodes, std::memory_order_relaxed);
+        published_qnodes.store(m_qnodes, std::memory_order_relaxed);
+        if (stop && stop->load(std::memory_order_relaxed))
+            m_stopped = true;
+    }
+
+    if (limits.nodes && m_nodes >= limits.nodes)
+        m_stopped = true;
+
+    return m_stopped;
+}
+
+void Searcher::update_pv(int ply, ChessMove move)
+{
+    m_pv[ply][ply] = move;
+    for (int i = ply + 1; i < m_pv_length[ply + 1]; i++)
+    {
+        m_pv[ply][i] = m_pv[ply + 1][i];
+    }
+    m_pv_length[ply] = m_pv_length[ply + 1];
+}
+
+// The quiet move that cut off gets a bonus growing with the depth, the quiets tried before it the
+// same malus. It also becomes a killer of this ply and the counter move to the move before.
+template <ChessColor Us>
+void Searcher::update_quiet_history(int ply, int depth, ChessMove best, const ChessMove* tried, int tried_count)
+{
+    MoveHistory& moves = *m_move_history;
+    int bonus = MIN(16 * depth * depth, MAX_HISTORY / 8);
+
+    s16* butterfly = moves.butterfly[int(Us)];
+    s16* continuation[2] = {
+        ply >= 1 ? moves.continuation[m_piece_to[ply - 1]] : nullptr,
+        ply >= 2 ? moves.continuation[m_piece_to[ply - 2]] : nullptr,
+    };
+
+    // the move is not on the board anymore, its piece-to is still in the stack
+    auto update = [&](ChessMove move, int piece_to, int amount) {
+        apply_history_bonus(&butterfly[move.data & 0xfff], amount);
+        for (s16* row : continuation)
+        {
+            if (row)
+                apply_history_bonus(&row[piece_to], amount);
+        }
+    };
+
+    update(best, m_piece_to[ply], bonus);
+    for (int i = 0; i < tried_count; i++)
+    {
+        update(tried[i], piece_to_index(m_state, tried[i]), -bonus);
+    }
+
+    ChessMove* killers = moves.killers[ply];
+    if (killers[0] != best)
+    {
+        for (int i = KILLER_SLOTS - 1; i > 0; i--)
+        {
+            killers[i] = killers[i - 1];
+        }
+        killers[0] = best;
+    }
+
+    if (ply >= 1)
+        moves.counter_moves[m_piece_to[ply - 1]] = best;
+}
+
+template <ChessColor Us>
+int Searcher::quiescence(int alpha, int beta, int ply, int qply)
+{
+    constexpr ChessColor Them = opposite_color(Us);
+
+    m_pv_length[ply] = ply;
+    m_nodes += 1;
+    m_qnodes += 1;
+    if (should_stop())
+        return 0;
+
+    // a check at the first ply is answered with every evasion and can not stand pat, later
+    // checks come from captures and are left to the evaluation
+    bool evasions = false;
+
+    // only the first ply follows a quiet move, captures and promotions can not repeat anything
+    if (qply == 0)
+    {
+        if (is_repetition(m_state, history) || has_insufficient_material(m_state))
+            return 0;
+
+        evasions = in_check(m_state);
+        if (is_fifty_move_draw(m_state) && !evasions)
+            return 0;
+    }
+
+    if (ply >= MAX_SEARCH_PLY - 1)
+        return evaluate(m_state);
+
+    int best_score = -INFINITE_SCORE;
+    int stand_pat = 0;
+    if (!evasions)
+    {
+        stand_pat = evaluate(m_state);
+        if (stand_pat >= beta)
+            return stand_pat;
+
+        best_score = stand_pat;
+        alpha = MAX(alpha, stand_pat);
+    }
+
+    MovePicker picker = evasions ? MovePicker(m_state, null_move()) : MovePicker::captures_only(m_state);
+    int move_count = 0;
+
+    ChessMove move;
+    while (!(move = picker.next()).is_null())
+    {
+        move_count += 1;
+
+        if (!evasions && move.kind() != MoveKind::Promotion)
+        {
+            // even winning the piece outright does not get back to alpha
+            PieceType captured = move.kind() == MoveKind::EnPassant ? PieceType::Pawn : m_state.piece_on(move.to());
+            if (stand_pat + see_piece_values[captured] + DELTA_MARGIN <= alpha)
+                continue;
+
+            if (!see_ge(m_state, move, 0))
+                continue;
+        }
+
+        ChessUndo undo;
+        history.add(m_state.hash);
+        make_move<Us>(&m_state, move, &undo);
+        int score = -quiescence<Them>(-beta, -alpha, ply + 1, qply + 1);
+        unmake_move<Us>(&m_state, move, undo);
+        history.pop();
+
+        if (m_stopped)
+            return 0;
+
+        if (score > best_score)
+        {
+            best_score = score;
+            if (score > alpha)
+            {
+                alpha = score;
+                update_pv(ply, move);
+                if (score >= beta)
+                    break;
+            }
+        }
+    }
+
+    if (evasions && !move_count)
+        return -MATE_SCORE + ply;
+
+    return best_score;
+}
+
+template <ChessColor Us>
+int Searcher::negamax(int alpha, int beta, int depth, int ply)
+{
+    constexpr ChessColor Them = opposite_color(Us);
+
+    if (depth <= 0)
+        return quiescence<Us>(alpha, beta, ply, 0);
+
+    m_pv_length[ply] = ply;
+    m_nodes += 1;
+    if (should_stop())
+        return 0;
+
+    if (ply > 0)
+    {
+        // a checkmate on the fiftieth move still counts, so that rule waits for the move loop
+        if (is_repetition(m_state, history) || has_insufficient_material(m_state))
+            return 0;
+        if (is_fifty_move_draw(m_state) && !in_check(m_state))
+            return 0;
+    }
+
+    if (ply >= MAX_SEARCH_PLY - 1)
+        return evaluate(m_state);
+
+    bool pv_node = beta - alpha > 1;
+
+    ChessMove hash_move = null_move();
+    if (table)
+    {
+        TranspositionHit hit;
+        table_stats.probes += 1;
+        if (table->probe(m_state.hash, &hit))
+        {
+            table_stats.hits += 1;
+            hash_move = hit.move;
+
+            int score = score_from_table(hit.score, ply);
+            if (!pv_node && hit.depth >= depth &&
+                (hit.bound == Bound::Exact ||
+                 (hit.bound == Bound::Lower && score >= beta) ||
+                 (hit.bound == Bound::Upper && score <= alpha)))
+            {
+                return score;
+            }
+        }
+    }
+
+    if (m_follow_pv)
+    {
+        if (ply < m_previous_pv_length)
+            hash_move = m_previous_pv[ply];
+        else
+            m_follow_pv = false;
+    }
+
+    MoveHistory& moves = *m_move_history;
+    QuietOrdering ordering;
+    ordering.butterfly = moves.butterfly[int(Us)];
+    if (ply >= 1)
+    {
+        ordering.continuation[0] = moves.continuation[m_piece_to[ply - 1]];
+        ordering.counter_move = moves.counter_moves[m_piece_to[ply - 1]];
+    }
+    if (ply >= 2)
+        ordering.continuation[1] = moves.continuation[m_piece_to[ply - 2]];
+
+    MovePicker picker(m_state, hash_move, moves.killers[ply], &picker_stats, &ordering);
+
+    int original_alpha = alpha;
+    int best_score = -INFINITE_SCORE;
+    ChessMove best_move = null_move();
+    int move_count = 0;
+
+    // the quiet moves that did not cut off, they lose history when a later one does
+    ChessMove quiets_tried[64];
+    int quiets_tried_count = 0;
+
+    ChessMove move;
+    while (!(move = picker.next()).is_null())
+    {
+        bool quiet = move.kind() != MoveKind::Promotion && move.kind() != MoveKind::EnPassant &&
+                     m_state.piece_on(move.to()) == PieceType::Sentinel;
+        m_piece_to[ply] = u16(piece_to_index(m_state, move));
+
+        ChessUndo undo;
+        history.add(m_state.hash);
+        make_move<Us>(&m_state, move, &undo);
+        move_count += 1;
+
+        // the first move is expected to be the best, the rest only have to be proven worse,
+        // which a null window does cheaply, and get a full search when that fails
+        int score;
+        if (move_count == 1)
+        {
+            score = -negamax<Them>(-beta, -alpha, depth - 1, ply + 1);
+        }
+        else
+        {
+            score = -negamax<Them>(-alpha - 1, -alpha, depth - 1, ply + 1);
+            if (score > alpha && score < beta)
+                score = -negamax<Them>(-beta, -alpha, depth - 1, ply + 1);
+        }
+
+        unmake_move<Us>(&m_state, move, undo);
+        history.pop();
+
+        // only the first move of a node can continue the last iteration's line
+        m_follow_pv = false;
+
+        if (m_stopped)
+            return 0;
+
+        if (score > best_score)
+        {
+            best_score = score;
+            if (score > alpha)
+            {
+                alpha = score;
+                best_move = move;
+                update_pv(ply, move);
+
+                if (score >= beta)
+                {
+                    ordering_stats.cutoffs += 1;
+                    ordering_stats.first_move_cutoffs += move_count == 1;
+                    if (quiet)
+                        update_quiet_history<Us>(ply, depth, move, quiets_tried, quiets_tried_count);
+                    break;
+                }
+            }
+        }
+
+        if (quiet && quiets_tried_count < int(ARRAY_SIZE(quiets_tried)))
+            quiets_tried[quiets_tried_count++] = move;
+    }
+
+    if (!move_count)
+        return in_check(m_state) ? -MATE_SCORE + ply : 0;
+
+    if (table)
+    {
+        Bound bound = best_score >= beta ? Bound::Lower : best_score > original_alpha ? Bound::Exact : Bound::Upper;
+        table->store(m_state.hash, best_move, score_to_table(best_score, ply), depth, bound);
+        table_stats.stores += 1;
+    }
+
+    return best_score;
+}
+
+// Helper i searches depth d only when (d + phase) / size is even, so each skips blocks of size
+// depths with its own phase and at any time the helpers are spread over the next few depths.
+static const int SkipSize[] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+static const int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+static bool helper_skips_depth(int helper_index, int depth)
+{
+    int i = (helper_index - 1) % int(ARRAY_SIZE(SkipSize));
+    return ((depth + SkipPhase[i]) / SkipSize[i]) % 2 != 0;
+}
+
+SearchReport Searcher::run(const ChessState& root)
+{
+    m_state = root;
+    m_nodes = 0;
+    m_qnodes = 0;
+    m_stopped = false;
+    ordering_stats = {};
+
+    // learned afresh for every search, what an earlier position taught is mostly noise here
+    if (!m_move_history)
+        m_move_history = new MoveHistory;
+    m_move_history->clear();
+    m_previous_pv_length = 0;
+    published_nodes.store(0, std::memory_order_relaxed);
+    published_qnodes.store(0, std::memory_order_relaxed);
+
+    SearchReport report;
+
+    // something to play even if the first iteration is cut short
+    ChessMove moves[MAX_MOVES];
+    int move_count = generate_legal_moves(root, moves);
+    if (move_count)
+    {
+        report.pv[0] = moves[0];
+        report.pv_length = 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    int max_depth = CLAMP(limits.depth, 1, MAX_SEARCH_PLY - 1);
+    for (int depth = 1; depth <= max_depth; depth++)
+    {
+        // depth 1 is too cheap to bother, and gives every helper a move to start from
+        if (helper_index && depth > 1 && helper_skips_depth(helper_index, depth))
+            continue;
+
+        m_follow_pv = true;
+        int score = root.side_to_move == ChessColor::White
+            ? negamax<ChessColor::White>(-INFINITE_SCORE, INFINITE_SCORE, depth, 0)
+            : negamax<ChessColor::Black>(-INFINITE_SCORE, INFINITE_SCORE, depth, 0);
+
+        if (m_stopped)
+            break;
+
+        report.depth = depth;
+        report.score = score;
+        report.nodes = m_nodes;
+        report.qnodes = m_qnodes;
+        report.seconds = elapsed_seconds(start);
+        report.pv_length = m_pv_length[0];
+        report.hashfull = table ? table->hashfull() : 0;
+        for (int i = 0; i < m_pv_length[0]; i++)
+        {
+            report.pv[i] = m_pv[0][i];
+            m_previous_pv[i] = m_pv[0][i];
+        }
+        m_previous_pv_length = m_pv_length[0];
+
+        if (on_iteration)
+            on_iteration(report, report_data);
+
+        // no moves at the root, or a mate close enough that this depth already saw all of it
+        int abs_score = score < 0 ? -score : score;
+        if (!move_count || (abs_score >= MATE_THRESHOLD && MATE_SCORE - abs_score <= depth))
+            break;
+    }
+
+    report.nodes = m_nodes;
+    report.qnodes = m_qnodes;
+    report.seconds = elapsed_seconds(start);
+    published_nodes.store(m_nodes, std::memory_order_relaxed);
+    published_qnodes.store(m_qnodes, std::memory_order_relaxed);
+    return report;
+}
+
+void ParallelSearch::helper_nodes(u64* nodes, u64* qnodes) const
+{
+    *nodes = 0;
+    *qnodes = 0;
+    for (int i = 1; i < thread_count; i++)
+    {
+        Searcher* searcher = m_searchers[i].load(std::memory_order_acquire);
+        if (searcher)
+        {
+            *nodes += searcher->published_nodes.load(std::memory_order_relaxed);
+            *qnodes += searcher->published_qnodes.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void ParallelSearch::forward_iteration(const SearchReport& report, void* data)
+{
+    ParallelSearch* search = (ParallelSearch*)data;
+
+    // the main thread's own count is exact, the helpers' lag by at most STOP_POLL_NODES each
+    u64 nodes = 0, qnodes = 0;
+    search->helper_nodes(&nodes, &qnodes);
+
+    SearchReport combined = report;
+    combined.nodes += nodes;
+    combined.qnodes += qnodes;
+
+    search->on_iteration(combined, search->report_data);
+}
+
+SearchReport ParallelSearch::run(const ChessState& root, const KeyHistory& history)
+{
+    int count = MAX(thread_count, 1);
+    m_searchers = new std::atomic<Searcher*>[count];
+    for (int i = 0; i < count; i++)
+    {
+        m_searchers[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> helpers_stop = false;
+    SearchReport main_report;
+
+    auto search_thread = [&](int index) {
+        // allocated by the thread that searches with it, first touch puts the pages on its numa node
+        Searcher* searcher = new Searcher;
+        searcher->history = history;
+        searcher->limits = limits;
+        searcher->table = table;
+        searcher->helper_index = index;
+
+        if (index == 0)
+        {
+            searcher->stop = stop;
+            searcher->on_iteration = on_iteration ? forward_iteration : nullptr;
+            searcher->report_data = this;
+        }
+        else
+        {
+            searcher->limits.nodes = 0;
+            searcher->stop = &helpers_stop;
+        }
+
+        m_searchers[index].store(searcher, std::memory_order_release);
+
+        SearchReport report = searcher->run(root);
+        if (index == 0)
+        {
+            main_report = report;
+            helpers_stop = true;
+        }
+    };
+
+    std::thread* helpers = new std::thread[count - 1];
+    for (int i = 1; i < count; i++)
+    {
+        helpers[i - 1] = std::thread(search_thread, i);
+    }
+
+    search_thread(0);
+
+    for (int i = 1; i < count; i++)
+    {
+        helpers[i - 1].join();
+    }
+    delete[] helpers;
+
+    picker_stats.clear();
+    table_stats = {};
+    ordering_stats = {};
+    total_nodes = 0;
+    total_qnodes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Searcher* searcher = m_searchers[i].load(std::memory_order_relaxed);
+        picker_stats += searcher->picker_stats;
+        table_stats += searcher->table_stats;
+        ordering_stats += searcher->ordering_stats;
+        total_nodes += searcher->published_nodes.load(std::memory_order_relaxed);
+        total_qnodes += searcher->published_qnodes.load(std::memory_order_relaxed);
+        delete searcher;
+    }
+
+    delete[] m_searchers;
+    m_searchers = nullptr;
+
+    main_report.nodes = total_nodes;
+    main_report.qnodes = total_qnodes;
+    return main_report;
+}
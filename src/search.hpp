@@ -0,0 +1,147 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include "chess.hpp"
+#include "move_picker.hpp"
+#include "transposition.hpp"
+
+#include <atomic>
+
+// Scores are centipawns from the side to move's point of view. Mates are MATE_SCORE minus the
+// plies to the mate, everything past MATE_THRESHOLD is one.
+#define MATE_SCORE 32000
+#define MATE_THRESHOLD (MATE_SCORE - MAX_SEARCH_PLY)
+#define INFINITE_SCORE 32001
+
+// the stop flag and the clock are only looked at once every this many nodes, a power of two
+#define STOP_POLL_NODES 2048
+
+// a capture that leaves the side this far short of alpha even after taking is not tried in quiescence
+#define DELTA_MARGIN 200
+
+struct SearchLimits {
+    int depth = MAX_SEARCH_PLY - 1;
+    u64 nodes = 0;  // no budget when zero
+};
+
+// what a finished iteration found, the principal variation starts with the move to play
+struct SearchReport {
+    int depth = 0;
+    int score = 0;
+    u64 nodes = 0;
+    u64 qnodes = 0;  // the part of nodes spent in the quiescence search
+    double seconds = 0;
+    ChessMove pv[MAX_SEARCH_PLY];
+    int pv_length = 0;
+    int hashfull = 0;  // permille, zero without a table
+
+    ChessMove best_move() const { return pv_length ? pv[0] : null_move(); }
+};
+
+// one line per iteration: depth, score, nodes, the quiescence share, nps, hashfull and the principal variation
+void print_search_report(const SearchReport& report);
+
+// Material and a little piece placement, from the side to move's point of view. Just enough for
+// the search to prefer sensible moves, it is not meant to play well.
+int evaluate(const ChessState& state);
+
+// Negamax alpha-beta with principal variation search under iterative deepening. Every depth
+// starts with the line the last one found, a finished depth is handed to on_iteration and only
+// finished depths count, an interrupted one is thrown away. Past the last ply a quiescence
+// search plays out captures and promotions until the position is quiet: the side to move may
+// stand pat on the evaluation, captures that can not reach alpha or lose material by SEE are
+// skipped, and a check at its first ply is answered with every evasion. Everything a thread writes while
+// searching lives in here, cache line aligned so two searchers never share a line.
+struct alignas(64) Searcher {
+    // the game before the root, positions repeated from it are draws
+    KeyHistory history = {};
+    SearchLimits limits = {};
+
+    // set from anywhere to end the search early, polled every STOP_POLL_NODES nodes
+    std::atomic<bool>* stop = nullptr;
+
+    // Optional and possibly shared with other searchers, whoever owns it calls new_search before
+    // every search. Exact scores and bounds deep enough cut off nodes outside the principal
+    // variation, otherwise the stored move is tried first.
+    TranspositionTable* table = nullptr;
+    TranspositionStats table_stats;
+
+    void (*on_iteration)(const SearchReport& report, void* data) = nullptr;
+    void* report_data = nullptr;
+
+    PickerStats picker_stats;
+    OrderingStats ordering_stats;
+
+    // 0 searches every depth, helpers of a parallel search skip some so they spread out
+    int helper_index = 0;
+
+    // the node counts for other threads to read, brought up to date whenever the stop flag is polled
+    std::atomic<u64> published_nodes = 0;
+    std::atomic<u64> published_qnodes = 0;
+
+    // the last finished iteration, only the first legal move if not even depth 1 finished
+    SearchReport run(const ChessState& root);
+
+    ~Searcher() { delete m_move_history; }
+
+private:
+    template <ChessColor Us> int negamax(int alpha, int beta, int depth, int ply);
+    template <ChessColor Us> int quiescence(int alpha, int beta, int ply, int qply);
+    template <ChessColor Us> void update_quiet_history(int ply, int depth, ChessMove best, const ChessMove* tried, int tried_count);
+    bool should_stop();
+    void update_pv(int ply, ChessMove move);
+
+    ChessState m_state;
+    u64 m_nodes = 0;
+    u64 m_qnodes = 0;
+    bool m_stopped = false;
+
+    // the line found below every ply, row ply holds the moves from ply on
+    ChessMove m_pv[MAX_SEARCH_PLY][MAX_SEARCH_PLY];
+    int m_pv_length[MAX_SEARCH_PLY];
+
+    // killers and history, over a megabyte so it gets its own allocation, made by the searching thread
+    MoveHistory* m_move_history = nullptr;
+    // piece-to index of the move played at every ply of the current line
+    u16 m_piece_to[MAX_SEARCH_PLY];
+
+    // the last iteration's line, tried first while the search walks along it
+    ChessMove m_previous_pv[MAX_SEARCH_PLY];
+    int m_previous_pv_length = 0;
+    bool m_follow_pv = false;
+};
+
+// Lazy SMP: every thread runs its own Searcher on the same root and they only talk through the
+// shared transposition table, what one thread stores saves the others the work. Helpers skip
+// depths in a staggered pattern so they run ahead of the main thread instead of repeating it.
+// The main thread runs on the calling thread and decides, its iterations are reported with the
+// nodes of all threads and its result is returned. The helpers stop once it is done, the node
+// budget only counts the main thread's nodes.
+struct ParallelSearch {
+    int thread_count = 1;
+    SearchLimits limits = {};
+
+    TranspositionTable* table = nullptr;
+    std::atomic<bool>* stop = nullptr;
+
+    void (*on_iteration)(const SearchReport& report, void* data) = nullptr;
+    void* report_data = nullptr;
+
+    // summed over all threads once run returns
+    PickerStats picker_stats;
+    OrderingStats ordering_stats;
+    TranspositionStats table_stats;
+    u64 total_nodes = 0;
+    u64 total_qnodes = 0;
+
+    // the main thread's last finished iteration, its node count covers every thread
+    SearchReport run(const ChessState& root, const KeyHistory& history);
+
+private:
+    static void forward_iteration(const SearchReport& report, void* data);
+    void helper_nodes(u64* nodes, u64* qnodes) const;
+
+    std::atomic<Searcher*>* m_searchers = nullptr;
+};
+
+#endif // _SEARCH_H
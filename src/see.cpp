@@ -0,0 +1,169 @@
+#include "see.hpp"
+
+#include "attack_tables.hpp"
+
+// longer exchanges need more than 32 pieces on the board
+#define MAX_EXCHANGE_DEPTH 32
+
+// What the move takes and what it leaves standing on the target square, en passant takes
+// from a different square and a promotion swaps the pawn for the new piece.
+struct ExchangeStart {
+    int gain;
+    int at_risk;
+    Bitboard occupied;
+};
+
+static ExchangeStart exchange_start(const ChessState& state, ChessMove move)
+{
+    SquareIndex from = move.from();
+    SquareIndex to = move.to();
+
+    ExchangeStart start;
+    start.occupied = (state.white | state.black) ^ BIT(from);
+    start.at_risk = see_piece_values[state.piece_on(from)];
+
+    PieceType captured = state.piece_on(to);
+    start.gain = captured == PieceType::Sentinel ? 0 : see_piece_values[captured];
+
+    if (move.kind() == MoveKind::EnPassant)
+    {
+        // the taken pawn stands next to the mover, on its row and the target's column
+        start.occupied ^= BIT((from & ~7) | (to & 7));
+        start.gain = see_piece_values[PieceType::Pawn];
+    }
+    else if (move.kind() == MoveKind::Promotion)
+    {
+        start.at_risk = see_piece_values[move.promotion()];
+        start.gain += start.at_risk - see_piece_values[PieceType::Pawn];
+    }
+
+    start.occupied |= BIT(to);
+    return start;
+}
+
+// the cheapest piece in the attackers, PieceType counts down from pawn to king in value order
+static PieceType least_valuable_attacker(const ChessState& state, Bitboard attackers, Bitboard* square)
+{
+    for (int type = PieceType::Pawn; type >= PieceType::King; type--)
+    {
+        Bitboard pieces = attackers & state.pieces[type];
+        if (pieces)
+        {
+            *square = pieces & (0 - pieces);
+            return PieceType(type);
+        }
+    }
+
+    return PieceType::Sentinel;
+}
+
+// sliders lined up behind the piece that just left, only the ray directions it could have blocked
+static Bitboard uncovered_attackers(const ChessState& state, SquareIndex to, PieceType taker, Bitboard occupied)
+{
+    Bitboard queens = state.pieces[PieceType::Queen];
+    Bitboard uncovered = 0;
+
+    if (taker == PieceType::Pawn || taker == PieceType::Bishop || taker == PieceType::Queen)
+        uncovered |= bishop_attacks(to, occupied) & (state.pieces[PieceType::Bishop] | queens);
+    if (taker == PieceType::Rook || taker == PieceType::Queen)
+        uncovered |= rook_attacks(to, occupied) & (state.pieces[PieceType::Rook] | queens);
+
+    return uncovered;
+}
+
+int see(const ChessState& state, ChessMove move)
+{
+    if (move.kind() == MoveKind::Castling)
+        return 0;
+
+    SquareIndex to = move.to();
+    ExchangeStart start = exchange_start(state, move);
+
+    Bitboard occupied = start.occupied;
+    Bitboard attackers = attackers_to(state, to, occupied) & occupied;
+    bool white_to_take = state.side_to_move != ChessColor::White;
+
+    // gain[d] is what the side taking at depth d is up if the exchange stopped right after
+    int gain[MAX_EXCHANGE_DEPTH];
+    int depth = 0;
+    gain[0] = start.gain;
+    int at_risk = start.at_risk;
+
+    while (depth + 1 < MAX_EXCHANGE_DEPTH)
+    {
+        Bitboard side = white_to_take ? state.white : state.black;
+        Bitboard square = 0;
+        PieceType taker = least_valuable_attacker(state, attackers & side, &square);
+        if (taker == PieceType::Sentinel)
+            break;
+
+        // the king can only take back once nothing defends the square anymore
+        if (taker == PieceType::King && (attackers & ~side))
+            break;
+
+        depth += 1;
+        gain[depth] = at_risk - gain[depth - 1];
+
+        occupied ^= square;
+        attackers = (attackers | uncovered_attackers(state, to, taker, occupied)) & occupied;
+        at_risk = see_piece_values[taker];
+        white_to_take = !white_to_take;
+    }
+
+    // every side takes back only when that beats stopping
+    while (depth > 0)
+    {
+        gain[depth - 1] = -MAX(-gain[depth - 1], gain[depth]);
+        depth -= 1;
+    }
+
+    return gain[0];
+}
+
+bool see_ge(const ChessState& state, ChessMove move, int threshold)
+{
+    if (move.kind() == MoveKind::Castling)
+        return 0 >= threshold;
+
+    SquareIndex to = move.to();
+    ExchangeStart start = exchange_start(state, move);
+
+    // already below the threshold even if the move is not answered
+    int swap = start.gain - threshold;
+    if (swap < 0)
+        return false;
+
+    // still above it after losing the piece for nothing
+    swap = start.at_risk - swap;
+    if (swap <= 0)
+        return true;
+
+    Bitboard occupied = start.occupied;
+    Bitboard attackers = attackers_to(state, to, occupied) & occupied;
+    bool white_to_take = state.side_to_move != ChessColor::White;
+
+    // result flips with every take back, swap holds what the side about to take has to win back
+    bool result = true;
+    while (true)
+    {
+        Bitboard side = white_to_take ? state.white : state.black;
+        Bitboard square = 0;
+        PieceType taker = least_valuable_attacker(state, attackers & side, &square);
+        if (taker == PieceType::Sentinel)
+            break;
+
+        if (taker == PieceType::King)
+            return (attackers & ~side) ? result : !result;
+
+        result = !result;
+        swap = see_piece_values[taker] - swap;
+        if (swap < int(result))
+            break;
+
+        occupied ^= square;
+        attackers = (attackers | uncovered_attackers(state, to, taker, occupied)) & occupied;
+        white_to_take = !white_to_take;
+    }
+
+    return result;
+}
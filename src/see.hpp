@@ -0,0 +1,28 @@
+#ifndef _SEE_H
+#define _SEE_H
+
+#include "chess.hpp"
+
+// Material the exchanges are counted in, indexed by PieceType. The king is worth more than
+// everything else together, so a line that loses it never looks good.
+constexpr int see_piece_values[PieceType::Count] = {
+    20000,  // King
+    900,    // Queen
+    500,    // Rook
+    330,    // Bishop
+    320,    // Knight
+    100,    // Pawn
+};
+
+// Static exchange evaluation of the move on its target square: the material the side to move
+// ends up with once both sides took back with their least valuable attacker for as long as it
+// paid off. Sliders behind the pieces that took are found as they are uncovered. Only bitboard
+// lookups, no move is made. Pins are not looked at, a pinned piece joins the exchange.
+// @note a pawn taking back on the last rank is still counted as a pawn, castling is always 0
+int see(const ChessState& state, ChessMove move);
+
+// see(state, move) >= threshold without building the whole exchange, stops as soon as the
+// answer is known. This is the one to use for pruning and ordering.
+bool see_ge(const ChessState& state, ChessMove move, int threshold);
+
+#endif // _SEE_H
@@ -10,7 +10,7 @@ private:
 	int m_cap = 0;
 
 public:
-	const T const * data() const { return m_data; }
+	const T* data() const { return m_data; }
 	int size() const { return m_size; }
 
 	DArray() {}
@@ -228,6 +228,73 @@ private:
 	}
 };
 
+// Array with its storage inline, it never allocates. Meant for things with a known upper
+// bound that get filled in hot code, like move lists.
+template <typename T, int N>
+struct FixedArray {
+private:
+	T m_data[N];
+	int m_size = 0;
+
+public:
+	T* data() { return m_data; }
+	const T* data() const { return m_data; }
+	int size() const { return m_size; }
+	static constexpr int capacity() { return N; }
+
+	// for code that writes straight into data(), like the move generator
+	void set_size(int size) {
+		if (size > N) panic("Fixed array overflow");
+		m_size = size;
+	}
+
+	void clear() {
+		m_size = 0;
+	}
+
+	bool in_bounds(int index) const {
+		return index < m_size && index >= 0;
+	}
+
+	bool is_empty() const {
+		return m_size == 0;
+	}
+
+	bool is_full() const {
+		return m_size == N;
+	}
+
+	T& operator[](int index) {
+		return m_data[index];
+	}
+
+	const T& operator[](int index) const {
+		return m_data[index];
+	}
+
+	int add(T elem) {
+		if (m_size >= N) panic("Fixed array overflow");
+		m_data[m_size] = elem;
+		m_size += 1;
+		return m_size - 1;
+	}
+
+	T pop() {
+		if (is_empty()) panic("Trying to pop from empty array");
+		m_size -= 1;
+		return m_data[m_size];
+	}
+
+	T& last() {
+		return m_data[m_size - 1];
+	}
+
+	T* begin() { return m_data; }
+	T* end() { return m_data + m_size; }
+	const T* begin() const { return m_data; }
+	const T* end() const { return m_data + m_size; }
+};
+
 template <typename T>
 struct Array {
 	T* data = NULL;
@@ -0,0 +1,130 @@
+#include "thread_pool.hpp"
+
+void ThreadPool::start(int thread_count)
+{
+    stop();
+
+    m_thread_count = MAX(thread_count, 1);
+    m_quit = false;
+    m_pending = 0;
+    m_queued = 0;
+    m_next_queue = 0;
+
+    m_queues = new WorkQueue[m_thread_count];
+    m_threads = new std::thread[m_thread_count];
+    for (int i = 0; i < m_thread_count; i++)
+    {
+        m_threads[i] = std::thread(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+void ThreadPool::stop()
+{
+    if (!m_threads)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_quit = true;
+    }
+    m_work_available.notify_all();
+
+    for (int i = 0; i < m_thread_count; i++)
+    {
+        m_threads[i].join();
+    }
+
+    delete[] m_threads;
+    delete[] m_queues;
+    m_threads = nullptr;
+    m_queues = nullptr;
+    m_thread_count = 0;
+}
+
+void ThreadPool::submit(ThreadTask task)
+{
+    WorkQueue& queue = m_queues[m_next_queue];
+    m_next_queue = (m_next_queue + 1) % m_thread_count;
+
+    // counted before it becomes visible, so a fast worker can never take the counts below zero
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_pending += 1;
+        m_queued += 1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    m_work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_sleep_mutex);
+    m_all_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::pop_local(int index, ThreadTask* task)
+{
+    WorkQueue& queue = m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+        return false;
+
+    *task = queue.tasks.back();
+    queue.tasks.pop_back();
+    m_queued -= 1;
+    return true;
+}
+
+bool ThreadPool::steal(int thief, ThreadTask* task)
+{
+    for (int i = 1; i < m_thread_count; i++)
+    {
+        WorkQueue& victim = m_queues[(thief + i) % m_thread_count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tasks.empty())
+        {
+            *task = victim.tasks.front();
+            victim.tasks.pop_front();
+            m_queued -= 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker_loop(int index)
+{
+    while (true)
+    {
+        ThreadTask task;
+        if (pop_local(index, &task) || steal(index, &task))
+        {
+            task.function(task.data);
+
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_pending -= 1;
+            if (m_pending == 0)
+            {
+                m_all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        if (m_quit)
+            return;
+
+        // tasks still running but none left to take means the others are finishing the last ones,
+        // nothing to do until the next submit
+        m_work_available.wait(lock, [this] { return m_quit || m_queued > 0; });
+        if (m_quit)
+            return;
+    }
+}
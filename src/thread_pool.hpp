@@ -0,0 +1,59 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include "common.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct ThreadTask {
+    void (*function)(void* data) = nullptr;
+    void* data = nullptr;
+};
+
+// Every worker owns a queue, takes work from its back and steals from the front of the others
+// when it runs dry. Tasks are expected to be coarse, like a whole perft subtree, so a lock per
+// queue is plenty.
+struct ThreadPool {
+    void start(int thread_count);
+    void stop();
+
+    // spread round robin over the workers, stealing evens out whatever is left uneven
+    void submit(ThreadTask task);
+    // blocks until every submitted task has finished
+    void wait();
+
+    int thread_count() const { return m_thread_count; }
+
+    ~ThreadPool() { stop(); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<ThreadTask> tasks;
+    };
+
+    void worker_loop(int index);
+    bool pop_local(int index, ThreadTask* task);
+    bool steal(int thief, ThreadTask* task);
+
+    std::thread* m_threads = nullptr;
+    WorkQueue* m_queues = nullptr;
+    int m_thread_count = 0;
+    int m_next_queue = 0;
+
+    // submitted and not finished, what wait blocks on
+    std::atomic<int> m_pending = 0;
+    // submitted and not yet taken by a worker, what idle workers sleep on
+    std::atomic<int> m_queued = 0;
+    std::atomic<bool> m_quit = false;
+
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_all_done;
+};
+
+#endif // _THREAD_POOL_H
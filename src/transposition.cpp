@@ -0,0 +1,158 @@
+#include "transposition.hpp"
+
+#include <new>
+#include <stdio.h>
+
+void TranspositionStats::operator+=(const TranspositionStats& other)
+{
+    probes += other.probes;
+    hits += other.hits;
+    stores += other.stores;
+}
+
+void TranspositionStats::print() const
+{
+    printf("  probes %12llu\n", (unsigned long long)probes);
+    printf("  hits   %12llu  %5.1f%%\n", (unsigned long long)hits, probes ? 100.0 * hits / probes : 0.0);
+    printf("  stores %12llu\n", (unsigned long long)stores);
+}
+
+bool TranspositionTable::resize(int megabytes)
+{
+    release();
+
+    u64 bytes = u64(MAX(megabytes, 1)) << 20;
+    u64 count = 1;
+    while (count * 2 * sizeof(Bucket) <= bytes)
+    {
+        count *= 2;
+    }
+
+    m_buckets = new (std::nothrow) Bucket[count];
+    if (!m_buckets)
+    {
+        return false;
+    }
+
+    m_mask = count - 1;
+    clear();
+    return true;
+}
+
+void TranspositionTable::clear()
+{
+    // also the first touch of the pages, done here rather than in the middle of a search
+    for (u64 i = 0; i <= m_mask && m_buckets; i++)
+    {
+        for (Entry& entry : m_buckets[i].entries)
+        {
+            entry.check.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    m_generation = 0;
+}
+
+void TranspositionTable::release()
+{
+    delete[] m_buckets;
+    m_buckets = nullptr;
+    m_mask = 0;
+}
+
+static inline Bound data_bound(u64 data) { return Bound((data >> 40) & 0x3); }
+static inline u8 data_generation(u64 data) { return u8(data >> 48); }
+static inline int data_depth(u64 data) { return int(s8(data >> 32)); }
+
+bool TranspositionTable::probe(u64 key, TranspositionHit* hit) const
+{
+    if (!m_buckets)
+        return false;
+
+    for (const Entry& entry : bucket(key).entries)
+    {
+        u64 data = entry.data.load(std::memory_order_relaxed);
+        u64 check = entry.check.load(std::memory_order_relaxed);
+
+        // an empty entry has no bound, so a zero key can not match it
+        if ((check ^ data) != key || data_bound(data) == Bound::None)
+            continue;
+
+        hit->move.data = u16(data);
+        hit->score = int(s16(data >> 16));
+        hit->depth = data_depth(data);
+        hit->bound = data_bound(data);
+        return true;
+    }
+
+    return false;
+}
+
+void TranspositionTable::store(u64 key, ChessMove move, int score, int depth, Bound bound)
+{
+    if (!m_buckets)
+        return;
+
+    Bucket& target = bucket(key);
+
+    // the same position is always overwritten, otherwise the entry worth least: shallow and from
+    // an old search, an empty one is worth nothing
+    Entry* replace = &target.entries[0];
+    int replace_worth = INT32_MAX;
+    u64 old_data = 0;
+
+    for (Entry& entry : target.entries)
+    {
+        u64 data = entry.data.load(std::memory_order_relaxed);
+        u64 check = entry.check.load(std::memory_order_relaxed);
+
+        if ((check ^ data) == key && data_bound(data) != Bound::None)
+        {
+            replace = &entry;
+            old_data = data;
+            break;
+        }
+
+        int age = u8(m_generation - data_generation(data));
+        int worth = data_bound(data) == Bound::None ? INT32_MIN : data_depth(data) - 2 * age;
+        if (worth < replace_worth)
+        {
+            replace = &entry;
+            replace_worth = worth;
+        }
+    }
+
+    // a search that found no move here should not wipe the one an earlier search found
+    if (move.is_null() && old_data)
+        move.data = u16(old_data);
+
+    u64 data = u64(move.data)
+             | (u64(u16(s16(score))) << 16)
+             | (u64(u8(s8(depth))) << 32)
+             | (u64(bound) << 40)
+             | (u64(m_generation) << 48);
+
+    replace->check.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const
+{
+    if (!m_buckets)
+        return 0;
+
+    // the first thousand entries are as good a sample as any, keys spread evenly
+    int buckets = int(MIN(m_mask + 1, u64(1000 / EntriesPerBucket)));
+    int used = 0;
+    for (int i = 0; i < buckets; i++)
+    {
+        for (const Entry& entry : m_buckets[i].entries)
+        {
+            u64 data = entry.data.load(std::memory_order_relaxed);
+            if (data_bound(data) != Bound::None && data_generation(data) == m_generation)
+                used += 1;
+        }
+    }
+
+    return used * 1000 / (buckets * EntriesPerBucket);
+}
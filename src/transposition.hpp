@@ -0,0 +1,80 @@
+#ifndef _TRANSPOSITION_H
+#define _TRANSPOSITION_H
+
+#include "chess.hpp"
+
+#include <atomic>
+
+// which side of the stored score the real value is on, a fail high only proves a lower bound
+enum class Bound : u8 {
+    None,
+    Upper,
+    Lower,
+    Exact,
+};
+
+// what a probe hands back, the score is as it was stored, mate distances are the caller's business
+struct TranspositionHit {
+    ChessMove move;
+    int score;
+    int depth;
+    Bound bound;
+};
+
+// counted by the caller so threads sharing a table do not fight over the counters
+struct TranspositionStats {
+    u64 probes = 0;
+    u64 hits = 0;
+    u64 stores = 0;
+
+    void operator+=(const TranspositionStats& other);
+    void print() const;
+};
+
+// Search results by Zobrist key, shared by every search thread without locks. A bucket is one
+// cache line of four 16 byte entries, each keeping key ^ data next to data like the perft hash,
+// so a write torn by another thread fails the check and reads as a miss. Entries remember the
+// search that wrote them, a new search prefers to replace old and shallow ones.
+struct TranspositionTable {
+    struct Entry {
+        // data bits: 0-15 move, 16-31 score, 32-39 depth, 40-41 bound, 48-55 generation
+        std::atomic<u64> check;
+        std::atomic<u64> data;
+    };
+
+    static constexpr int EntriesPerBucket = 4;
+
+    struct alignas(64) Bucket {
+        Entry entries[EntriesPerBucket];
+    };
+
+    static_assert(sizeof(Bucket) == 64, "a bucket is one cache line");
+
+    // Rounds down to a power of two buckets, at least 1 MB. Clears the table, so never while
+    // a search is running.
+    bool resize(int megabytes);
+    void clear();
+    void release();
+
+    // called once before every search, entries from earlier ones become the first to go
+    void new_search() { m_generation += 1; }
+
+    bool probe(u64 key, TranspositionHit* hit) const;
+    void store(u64 key, ChessMove move, int score, int depth, Bound bound);
+
+    // permille of a sample of entries written by the current search, like the uci hashfull
+    int hashfull() const;
+
+    u64 size_in_bytes() const { return m_buckets ? (m_mask + 1) * sizeof(Bucket) : 0; }
+
+    ~TranspositionTable() { release(); }
+
+private:
+    Bucket& bucket(u64 key) const { return m_buckets[key & m_mask]; }
+
+    Bucket* m_buckets = nullptr;
+    u64 m_mask = 0;
+    u8 m_generation = 0;
+};
+
+#endif // _TRANSPOSITION_H